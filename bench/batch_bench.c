@@ -0,0 +1,126 @@
+/*
+ * batch_bench.c: Compares allocating and freeing n objects of one size with
+ *                a loop of malloc and free against a single mm_malloc_batch
+ *                and mm_free_batch, for slab objects, blocks served by the
+ *                thread cache and larger blocks. Each round allocates n
+ *                objects, writes their first byte, and frees them.
+ *
+ *                The loop takes the arena lock once per object that misses
+ *                the thread cache; the batch calls take it once per round,
+ *                and carve or join the blocks in one go.
+ *
+ * Build:  make bench/batch_bench
+ * Usage:  bench/batch_bench [n = 256] [rounds = 2000]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/*
+ * now_ns: Returns a monotonic timestamp in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * run_loop: Returns the time per object, in nanoseconds, of allocating and
+ *           freeing n objects of size bytes one by one, over rounds rounds
+ */
+static double run_loop(size_t size, size_t n, int rounds, void **ptrs)
+{
+    uint64_t start = now_ns();
+
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if ((ptrs[i] = mm_malloc(size)) == NULL)
+            {
+                fprintf(stderr, "malloc of %zu bytes failed\n", size);
+                exit(1);
+            }
+            *(char *)ptrs[i] = (char)i;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            mm_free(ptrs[i]);
+        }
+    }
+
+    return (double)(now_ns() - start) / ((double)rounds * (double)n);
+}
+
+/*
+ * run_batch: Returns the time per object, in nanoseconds, of allocating and
+ *            freeing n objects of size bytes in batches, over rounds rounds
+ */
+static double run_batch(size_t size, size_t n, int rounds, void **ptrs)
+{
+    uint64_t start = now_ns();
+
+    for (int r = 0; r < rounds; r++)
+    {
+        if (mm_malloc_batch(size, n, ptrs) != n)
+        {
+            fprintf(stderr, "batch of %zu bytes failed\n", size);
+            exit(1);
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            *(char *)ptrs[i] = (char)i;
+        }
+        mm_free_batch(ptrs, n);
+    }
+
+    return (double)(now_ns() - start) / ((double)rounds * (double)n);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = {16, 64, 200, 512, 1000, 4000, 16000};
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 256;
+    int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+    void **ptrs;
+
+    if (n == 0)
+    {
+        n = 1;
+    }
+    if (rounds <= 0)
+    {
+        rounds = 1;
+    }
+    if ((ptrs = calloc(n, sizeof(*ptrs))) == NULL)
+    {
+        return 1;
+    }
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    printf("%8s %12s %12s\n", "size", "loop_ns", "batch_ns");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        // Warm up, so that both start from a heap of the same size
+        run_batch(sizes[i], n, 1, ptrs);
+        printf("%8zu %12.1f %12.1f\n", sizes[i],
+               run_loop(sizes[i], n, rounds, ptrs),
+               run_batch(sizes[i], n, rounds, ptrs));
+    }
+
+    free(ptrs);
+    return 0;
+}
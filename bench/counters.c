@@ -0,0 +1,181 @@
+/*
+ * counters.c: Opens each hardware counter on its own, counting in user
+ *             space only, which perf_event_paranoid up to 2 allows, and
+ *             scales the counts when the kernel multiplexes them.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "counters.h"
+
+#define CACHE_READ_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) \
+                                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct
+{
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} events[NCOUNTERS] =
+{
+    {"instr", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1d_miss", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {"LLC_miss", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {"dTLB_miss", PERF_TYPE_HW_CACHE,
+     CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {"br_miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+/*
+ * counters_open: Opens the counters of the calling thread, disabled and
+ *                zeroed. Returns false, after saying why, if none of them
+ *                is available.
+ */
+bool counters_open(counters_t *c)
+{
+    int err = 0;
+    bool any = false;
+
+    for (int i = 0; i < NCOUNTERS; i++)
+    {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        c->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        c->values[i] = 0;
+        if (c->fds[i] < 0)
+        {
+            err = errno;
+            c->fds[i] = -1;
+        }
+        else
+        {
+            any = true;
+        }
+    }
+
+    if (!any)
+    {
+        fprintf(stderr, "hardware counters unavailable: %s\n", strerror(err));
+    }
+    return any;
+}
+
+/*
+ * counters_start: Starts counting, from where the counters stopped
+ */
+void counters_start(counters_t *c)
+{
+    for (int i = 0; i < NCOUNTERS; i++)
+    {
+        if (c->fds[i] >= 0)
+        {
+            ioctl(c->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(c->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/*
+ * counters_stop: Stops counting, and adds the counts since counters_start
+ *                to the values of c
+ */
+void counters_stop(counters_t *c)
+{
+    for (int i = 0; i < NCOUNTERS; i++)
+    {
+        uint64_t buf[3];        // value, time enabled, time running
+
+        if (c->fds[i] < 0)
+        {
+            continue;
+        }
+        ioctl(c->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(c->fds[i], buf, sizeof(buf)) != sizeof(buf))
+        {
+            continue;
+        }
+        // Counted only part of the time if the kernel multiplexed it
+        if (buf[2] != 0)
+        {
+            c->values[i] += (double)buf[0] * (double)buf[1] / (double)buf[2];
+        }
+    }
+}
+
+/*
+ * counters_reset: Zeroes the values of c
+ */
+void counters_reset(counters_t *c)
+{
+    for (int i = 0; i < NCOUNTERS; i++)
+    {
+        c->values[i] = 0;
+    }
+}
+
+/*
+ * counters_close: Closes the counters of c
+ */
+void counters_close(counters_t *c)
+{
+    for (int i = 0; i < NCOUNTERS; i++)
+    {
+        if (c->fds[i] >= 0)
+        {
+            close(c->fds[i]);
+            c->fds[i] = -1;
+        }
+    }
+}
+
+/*
+ * counters_print_header: Prints the names of the counters, as a line of
+ *                        columns after indent
+ */
+void counters_print_header(FILE *f, const char *indent)
+{
+    fprintf(f, "%s", indent);
+    for (int i = 0; i < NCOUNTERS; i++)
+    {
+        fprintf(f, " %12s", events[i].name);
+    }
+    fprintf(f, "   per op\n");
+}
+
+/*
+ * counters_print: Prints the values of c divided by ops, as a line of
+ *                 columns after indent
+ */
+void counters_print(FILE *f, const char *indent, const counters_t *c,
+                    double ops)
+{
+    fprintf(f, "%s", indent);
+    for (int i = 0; i < NCOUNTERS; i++)
+    {
+        if (c->fds[i] < 0 || ops == 0)
+        {
+            fprintf(f, " %12s", "-");
+        }
+        else
+        {
+            fprintf(f, " %12.2f", c->values[i] / ops);
+        }
+    }
+    fprintf(f, "\n");
+}
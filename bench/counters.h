@@ -0,0 +1,39 @@
+/*
+ * counters.h: Hardware performance counters for the benchmarks, read with
+ *             perf_event_open around the phases they measure. Counters the
+ *             machine or the container does not provide are left out and
+ *             print as -, so the other columns stay comparable.
+ */
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+enum
+{
+    CTR_INSTRUCTIONS,
+    CTR_L1D_MISSES,
+    CTR_LLC_MISSES,
+    CTR_DTLB_MISSES,
+    CTR_BRANCH_MISSES,
+    NCOUNTERS
+};
+
+typedef struct counters
+{
+    int fds[NCOUNTERS];             // -1 if not available
+    double values[NCOUNTERS];       // summed over the phases
+} counters_t;
+
+extern bool counters_open(counters_t *c);
+extern void counters_start(counters_t *c);
+extern void counters_stop(counters_t *c);
+extern void counters_reset(counters_t *c);
+extern void counters_close(counters_t *c);
+extern void counters_print_header(FILE *f, const char *indent);
+extern void counters_print(FILE *f, const char *indent,
+                           const counters_t *c, double ops);
+
+#endif
@@ -0,0 +1,585 @@
+/*
+ * latency.c: Times every malloc, free, realloc and calloc of a workload and
+ *            prints, for each, the percentiles of the latencies recorded in
+ *            a log-linear histogram of under 1% error, the way HdrHistogram
+ *            does, so that the rare slow requests which averages hide, such
+ *            as those extending the heap or walking a long free list, show
+ *            up as p99.9 and max.
+ *
+ *            The workload first allocates its working set of blocks, which
+ *            is not timed. Then each step allocates a burst of blocks, a
+ *            tenth of them with calloc, and frees as many live blocks in the
+ *            order of the lifetime pattern: the newest first (lifo), the
+ *            oldest first (fifo) or at random. A share of the steps also
+ *            reallocates a random live block to a new size.
+ *
+ *            Sizes follow one of the distributions:
+ *              fixed:N                    always N bytes
+ *              uniform:LO:HI              uniform between LO and HI
+ *              powerlaw:LO:HI[:ALPHA]     bounded power law, ALPHA = 1.5,
+ *                                         most sizes near LO
+ *              bimodal:SMALL:LARGE:PCT    LARGE for PCT percent of them
+ *
+ *            Times are read from the time stamp counter where there is one,
+ *            calibrated against the monotonic clock, and the cost of reading
+ *            the timer is subtracted. With -p, the hardware counters
+ *            (counters.c) count over the timed steps, and their counts are
+ *            printed per request; they include the work of the benchmark
+ *            around the requests.
+ *
+ * Build:  make bench/latency
+ * Usage:  bench/latency [-a mm|libc] [-d dist] [-l lifo|fifo|random]
+ *                       [-n steps] [-w working set] [-b burst] [-r realloc %]
+ *                       [-c calloc %] [-s seed] [-p]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "mm.h"
+#include "memlib.h"
+#include "counters.h"
+
+#define HIST_BITS 7                          // sub-buckets per power of two
+#define HIST_SUB (1 << HIST_BITS)
+#define HIST_SIZE ((64 - HIST_BITS + 1) * (HIST_SUB / 2) + HIST_SUB / 2)
+
+enum { OP_MALLOC, OP_FREE, OP_REALLOC, OP_CALLOC, OP_COUNT };
+
+typedef struct hist
+{
+    uint64_t counts[HIST_SIZE];
+    uint64_t total;
+    uint64_t max;
+    double sum;
+} hist_t;
+
+typedef struct dist
+{
+    enum { DIST_FIXED, DIST_UNIFORM, DIST_POWERLAW, DIST_BIMODAL } kind;
+    size_t lo;
+    size_t hi;
+    double param;           // alpha of powerlaw, share of LARGE of bimodal
+} dist_t;
+
+typedef struct allocator
+{
+    const char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+} allocator_t;
+
+/* Live blocks, oldest first, in a ring */
+typedef struct pool
+{
+    void **ptrs;
+    size_t cap;             // power of two
+    size_t head;
+    size_t count;
+} pool_t;
+
+static const allocator_t allocators[] =
+{
+    {"mm", mm_malloc, mm_free, mm_realloc, mm_calloc},
+    {"libc", malloc, free, realloc, calloc},
+};
+
+static const char *op_names[OP_COUNT] = {"malloc", "free", "realloc", "calloc"};
+static hist_t hists[OP_COUNT];
+static uint64_t seed = 88172645463325252ull;
+static double ns_per_tick = 1;
+static uint64_t timer_cost;
+
+static uint64_t ticks(void);
+static uint64_t ticks_end(void);
+static void calibrate(void);
+static uint64_t rnd(void);
+static double rnd_unit(void);
+static bool parse_dist(const char *s, dist_t *d);
+static size_t draw_size(const dist_t *d);
+static size_t hist_index(uint64_t v);
+static uint64_t hist_value(size_t index);
+static void hist_add(hist_t *h, uint64_t v);
+static uint64_t hist_percentile(const hist_t *h, double p);
+static void pool_push(pool_t *p, void *ptr);
+static void *pool_take(pool_t *p, char order);
+static void *pool_at(pool_t *p, size_t i);
+static void pool_set(pool_t *p, size_t i, void *ptr);
+
+
+int main(int argc, char **argv)
+{
+    const allocator_t *al = &allocators[0];
+    const char *dist_arg = "powerlaw:16:4096";
+    char order = 'l';
+    size_t steps = 1000000;
+    size_t working = 10000;
+    size_t burst = 16;
+    unsigned realloc_pct = 5;
+    unsigned calloc_pct = 10;
+    dist_t dist;
+    bool use_counters = false;
+    counters_t ctrs;
+    uint64_t nops = 0;
+    pool_t pool;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:d:l:n:w:b:r:c:s:p")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            al = strcmp(optarg, "libc") == 0 ? &allocators[1] : &allocators[0];
+            break;
+        case 'd':
+            dist_arg = optarg;
+            break;
+        case 'l':
+            order = optarg[0];
+            break;
+        case 'p':
+            use_counters = true;
+            break;
+        case 'n':
+            steps = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            working = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            burst = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            realloc_pct = (unsigned)atoi(optarg);
+            break;
+        case 'c':
+            calloc_pct = (unsigned)atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0) | 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-a mm|libc] [-d dist] "
+                    "[-l lifo|fifo|random] [-n steps] [-w working set] "
+                    "[-b burst] [-r realloc %%] [-c calloc %%] [-s seed] "
+                    "[-p]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (!parse_dist(dist_arg, &dist))
+    {
+        fprintf(stderr, "bad distribution %s\n", dist_arg);
+        return 2;
+    }
+    if (order != 'l' && order != 'f' && order != 'r')
+    {
+        fprintf(stderr, "bad lifetime pattern, lifo, fifo or random\n");
+        return 2;
+    }
+    if (burst == 0)
+    {
+        burst = 1;
+    }
+
+    pool.cap = 1;
+    while (pool.cap < working + burst)
+    {
+        pool.cap *= 2;
+    }
+    pool.ptrs = calloc(pool.cap, sizeof(*pool.ptrs));
+    pool.head = 0;
+    pool.count = 0;
+
+    mem_init();
+    if (pool.ptrs == NULL || !mm_init())
+    {
+        fprintf(stderr, "initialization failed\n");
+        return 1;
+    }
+    calibrate();
+
+    // The working set is allocated untimed
+    while (pool.count < working)
+    {
+        pool_push(&pool, al->malloc(draw_size(&dist)));
+    }
+
+    if (use_counters)
+    {
+        counters_open(&ctrs);
+        counters_start(&ctrs);
+    }
+    for (size_t step = 0; step < steps; step++)
+    {
+        uint64_t start, end;
+        void *ptr;
+
+        for (size_t i = 0; i < burst; i++)
+        {
+            size_t size = draw_size(&dist);
+            int op = rnd() % 100 < calloc_pct ? OP_CALLOC : OP_MALLOC;
+
+            start = ticks();
+            ptr = op == OP_CALLOC ? al->calloc(1, size) : al->malloc(size);
+            end = ticks_end();
+            if (ptr == NULL)
+            {
+                fprintf(stderr, "allocation of %zu bytes failed\n", size);
+                return 1;
+            }
+            *(volatile char *)ptr = 1;
+            hist_add(&hists[op], end - start);
+            pool_push(&pool, ptr);
+        }
+
+        if (rnd() % 100 < realloc_pct && pool.count != 0)
+        {
+            size_t i = (size_t)(rnd() % pool.count);
+            size_t size = draw_size(&dist);
+
+            start = ticks();
+            ptr = al->realloc(pool_at(&pool, i), size);
+            end = ticks_end();
+            if (ptr == NULL)
+            {
+                fprintf(stderr, "realloc to %zu bytes failed\n", size);
+                return 1;
+            }
+            hist_add(&hists[OP_REALLOC], end - start);
+            pool_set(&pool, i, ptr);
+        }
+
+        for (size_t i = 0; i < burst; i++)
+        {
+            ptr = pool_take(&pool, order);
+            start = ticks();
+            al->free(ptr);
+            end = ticks_end();
+            hist_add(&hists[OP_FREE], end - start);
+        }
+    }
+    if (use_counters)
+    {
+        counters_stop(&ctrs);
+    }
+
+    printf("allocator %s, sizes %s, %s lifetimes, working set %zu, "
+           "timer cost %.0f ns\n", al->name, dist_arg,
+           order == 'l' ? "lifo" : order == 'f' ? "fifo" : "random",
+           working, (double)timer_cost * ns_per_tick);
+    printf("%-8s %10s %8s %8s %8s %8s %8s %10s\n", "op", "count", "mean",
+           "p50", "p90", "p99", "p99.9", "max");
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        hist_t *h = &hists[op];
+
+        if (h->total == 0)
+        {
+            continue;
+        }
+        printf("%-8s %10llu %8.1f %8.0f %8.0f %8.0f %8.0f %10.0f\n",
+               op_names[op], (unsigned long long)h->total,
+               h->sum / (double)h->total * ns_per_tick,
+               (double)hist_percentile(h, 0.5) * ns_per_tick,
+               (double)hist_percentile(h, 0.9) * ns_per_tick,
+               (double)hist_percentile(h, 0.99) * ns_per_tick,
+               (double)hist_percentile(h, 0.999) * ns_per_tick,
+               (double)h->max * ns_per_tick);
+        nops += h->total;
+    }
+    if (use_counters)
+    {
+        counters_print_header(stdout, "");
+        counters_print(stdout, "", &ctrs, (double)nops);
+    }
+
+    return 0;
+}
+
+/*
+ * ticks: Reads the timer at the start of a timed request, after the
+ *        instructions before it have completed
+ */
+static uint64_t ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/*
+ * ticks_end: Reads the timer at the end of a timed request, once it has
+ *            completed
+ */
+static uint64_t ticks_end(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned aux;
+    uint64_t t = __rdtscp(&aux);
+
+    _mm_lfence();
+    return t;
+#else
+    return ticks();
+#endif
+}
+
+/*
+ * calibrate: Measures the length of a tick against the monotonic clock and
+ *            the least cost of reading the timer twice
+ */
+static void calibrate(void)
+{
+    struct timespec t0, t1;
+    uint64_t start, end;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    start = ticks();
+    do
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ns = (double)(t1.tv_sec - t0.tv_sec) * 1e9 +
+             (double)(t1.tv_nsec - t0.tv_nsec);
+    } while (ns < 2e7);
+    end = ticks_end();
+    ns_per_tick = ns / (double)(end - start);
+
+    timer_cost = UINT64_MAX;
+    for (int i = 0; i < 10000; i++)
+    {
+        start = ticks();
+        end = ticks_end();
+        if (end - start < timer_cost)
+        {
+            timer_cost = end - start;
+        }
+    }
+}
+
+/*
+ * rnd: Returns a pseudo-random number, from a xorshift generator
+ */
+static uint64_t rnd(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+/*
+ * rnd_unit: Returns a pseudo-random number in [0, 1)
+ */
+static double rnd_unit(void)
+{
+    return (double)(rnd() >> 11) / (double)(1ull << 53);
+}
+
+/*
+ * parse_dist: Parses a size distribution into d. Returns false if it is
+ *             malformed.
+ */
+static bool parse_dist(const char *s, dist_t *d)
+{
+    unsigned long a = 0, b = 0;
+    double c = 0;
+    int n;
+
+    if (sscanf(s, "fixed:%lu", &a) == 1)
+    {
+        d->kind = DIST_FIXED;
+        d->lo = d->hi = a;
+    }
+    else if (sscanf(s, "uniform:%lu:%lu", &a, &b) == 2 && a <= b)
+    {
+        d->kind = DIST_UNIFORM;
+        d->lo = a;
+        d->hi = b;
+    }
+    else if ((n = sscanf(s, "powerlaw:%lu:%lu:%lf", &a, &b, &c)) >= 2 &&
+             a != 0 && a <= b)
+    {
+        d->kind = DIST_POWERLAW;
+        d->lo = a;
+        d->hi = b;
+        d->param = n == 3 ? c : 1.5;
+        if (d->param == 1)
+        {
+            return false;
+        }
+    }
+    else if (sscanf(s, "bimodal:%lu:%lu:%lf", &a, &b, &c) == 3)
+    {
+        d->kind = DIST_BIMODAL;
+        d->lo = a;
+        d->hi = b;
+        d->param = c / 100;
+    }
+    else
+    {
+        return false;
+    }
+    return d->hi != 0;
+}
+
+/*
+ * draw_size: Returns a size drawn from d
+ */
+static size_t draw_size(const dist_t *d)
+{
+    double a, lo, hi;
+
+    switch (d->kind)
+    {
+    case DIST_FIXED:
+        return d->lo;
+    case DIST_UNIFORM:
+        return d->lo + (size_t)(rnd() % (d->hi - d->lo + 1));
+    case DIST_POWERLAW:
+        // Inverse of the distribution function of the bounded power law
+        a = 1 - d->param;
+        lo = pow((double)d->lo, a);
+        hi = pow((double)d->hi + 1, a);
+        return (size_t)pow(lo + rnd_unit() * (hi - lo), 1 / a);
+    default:
+        return rnd_unit() < d->param ? d->hi : d->lo;
+    }
+}
+
+/*
+ * hist_index: Returns the bucket of v. Values below HIST_SUB have buckets of
+ *             their own; above, each power of two is split in HIST_SUB / 2
+ *             buckets, so a bucket is less than 1/64 of its values wide.
+ */
+static size_t hist_index(uint64_t v)
+{
+    unsigned shift;
+
+    if (v < HIST_SUB)
+    {
+        return (size_t)v;
+    }
+    shift = (unsigned)(63 - __builtin_clzll(v)) - (HIST_BITS - 1);
+    return (size_t)shift * (HIST_SUB / 2) + (size_t)(v >> shift);
+}
+
+/*
+ * hist_value: Returns the highest value of bucket index
+ */
+static uint64_t hist_value(size_t index)
+{
+    unsigned shift;
+
+    if (index < HIST_SUB)
+    {
+        return index;
+    }
+    shift = (unsigned)(index / (HIST_SUB / 2)) - 1;
+    return (((uint64_t)(index - shift * (HIST_SUB / 2)) + 1) << shift) - 1;
+}
+
+/*
+ * hist_add: Records v, less the cost of reading the timer, in h
+ */
+static void hist_add(hist_t *h, uint64_t v)
+{
+    v = v > timer_cost ? v - timer_cost : 0;
+    h->counts[hist_index(v)]++;
+    h->total++;
+    h->sum += (double)v;
+    if (v > h->max)
+    {
+        h->max = v;
+    }
+}
+
+/*
+ * hist_percentile: Returns the value below or at which a share p of the
+ *                  values of h lie
+ */
+static uint64_t hist_percentile(const hist_t *h, double p)
+{
+    uint64_t want = (uint64_t)ceil(p * (double)h->total);
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < HIST_SIZE; i++)
+    {
+        seen += h->counts[i];
+        if (seen >= want && seen != 0)
+        {
+            uint64_t v = hist_value(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+/*
+ * pool_push: Adds ptr as the newest live block
+ */
+static void pool_push(pool_t *p, void *ptr)
+{
+    p->ptrs[(p->head + p->count++) & (p->cap - 1)] = ptr;
+}
+
+/*
+ * pool_take: Removes and returns the newest live block for lifo order, the
+ *            oldest for fifo, and a random one otherwise
+ */
+static void *pool_take(pool_t *p, char order)
+{
+    void *ptr;
+    size_t i;
+
+    if (order == 'f')
+    {
+        ptr = p->ptrs[p->head];
+        p->head = (p->head + 1) & (p->cap - 1);
+        p->count--;
+        return ptr;
+    }
+    if (order == 'r')
+    {
+        // The newest block takes the place of the one taken
+        i = (size_t)(rnd() % p->count);
+        ptr = pool_at(p, i);
+        pool_set(p, i, pool_at(p, p->count - 1));
+        p->count--;
+        return ptr;
+    }
+    return p->ptrs[(p->head + --p->count) & (p->cap - 1)];
+}
+
+/*
+ * pool_at: Returns the live block i, counting from the oldest
+ */
+static void *pool_at(pool_t *p, size_t i)
+{
+    return p->ptrs[(p->head + i) & (p->cap - 1)];
+}
+
+/*
+ * pool_set: Replaces the live block i with ptr
+ */
+static void pool_set(pool_t *p, size_t i, void *ptr)
+{
+    p->ptrs[(p->head + i) & (p->cap - 1)] = ptr;
+}
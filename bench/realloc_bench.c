@@ -0,0 +1,127 @@
+/*
+ * realloc_bench.c: Measures the cost of growing a large buffer with realloc,
+ *                  for buffer sizes doubling from 1 MiB. Each round allocates
+ *                  and touches a buffer, allocates a small block after it so
+ *                  that it cannot simply grow into the rest of the heap, and
+ *                  times a single realloc growing the buffer by step bytes.
+ *
+ *                  Mapped chunks are resized by mremap, whose cost stays flat
+ *                  as the buffer grows; with mapping disabled the buffer lives
+ *                  on the heap and realloc copies it, so the cost grows with
+ *                  the buffer.
+ *
+ * Build:  make bench/realloc_bench
+ * Usage:  bench/realloc_bench [max MiB = 64] [rounds = 16] [step = 65536]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+extern void mm_set_mmap_threshold(size_t size, bool dynamic);
+
+/*
+ * now_ns: Returns a monotonic timestamp in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * cmp_u64: qsort comparator of uint64_t values
+ */
+static int cmp_u64(const void *x, const void *y)
+{
+    uint64_t a = *(const uint64_t *)x;
+    uint64_t b = *(const uint64_t *)y;
+
+    return (a > b) - (a < b);
+}
+
+/*
+ * grow_median: Returns the median time, in nanoseconds, of growing a touched
+ *              buffer of size bytes by step bytes, over rounds rounds, or 0
+ *              if an allocation fails
+ */
+static uint64_t grow_median(size_t size, size_t step, int rounds)
+{
+    uint64_t *times = calloc((size_t)rounds, sizeof(*times));
+    uint64_t median;
+    uint64_t start;
+    char *p, *q, *fence;
+
+    for (int r = 0; r < rounds; r++)
+    {
+        p = mm_malloc(size);
+        fence = mm_malloc(4096);
+        if (p == NULL || fence == NULL)
+        {
+            free(times);
+            return 0;
+        }
+        memset(p, r, size);
+
+        start = now_ns();
+        q = mm_realloc(p, size + step);
+        times[r] = now_ns() - start;
+
+        if (q == NULL || q[size - 1] != (char)r)
+        {
+            fprintf(stderr, "realloc of %zu bytes failed\n", size);
+            exit(1);
+        }
+        mm_free(q);
+        mm_free(fence);
+    }
+
+    qsort(times, (size_t)rounds, sizeof(*times), cmp_u64);
+    median = times[rounds / 2];
+    free(times);
+    return median;
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_mib = argc > 1 ? strtoul(argv[1], NULL, 0) : 64;
+    int rounds = argc > 2 ? atoi(argv[2]) : 16;
+    size_t step = argc > 3 ? strtoul(argv[3], NULL, 0) : 65536;
+
+    if (rounds <= 0)
+    {
+        rounds = 1;
+    }
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    printf("%10s %14s %14s\n", "size_mib", "mremap_ns", "copy_ns");
+    for (size_t mib = 1; mib <= max_mib; mib *= 2)
+    {
+        size_t size = mib << 20;
+        uint64_t mapped, copied;
+
+        // Fixed threshold, so that freed buffers do not raise it
+        mm_set_mmap_threshold(1 << 20, false);
+        mapped = grow_median(size, step, rounds);
+
+        mm_set_mmap_threshold(0, false);
+        copied = grow_median(size, step, rounds);
+
+        printf("%10zu %14llu %14llu\n", mib, (unsigned long long)mapped,
+               (unsigned long long)copied);
+    }
+
+    return 0;
+}
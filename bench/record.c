@@ -0,0 +1,562 @@
+/*
+ * record.c: Records the allocation requests of a program as a trace for
+ *           bench/replay. Loaded with LD_PRELOAD, in front of libmm.so or of
+ *           the system malloc, it passes every request on to the malloc
+ *           below it and writes it to the file named by MM_RECORD, with the
+ *           addresses of the blocks as their ids:
+ *
+ *             MM_RECORD=trace.rep LD_PRELOAD=bench/librecord.so <program>
+ *             MM_RECORD=trace.rep LD_PRELOAD="bench/librecord.so ./libmm.so" \
+ *                 <program>
+ *
+ *           %p in the name is replaced by the process id. Without it, a
+ *           forked child stops recording, and a program started by the
+ *           recorded one truncates the file, so programs that start others
+ *           should be recorded with %p.
+ *
+ *           calloc and the aligned allocations are recorded as mallocs of the
+ *           same size, and the allocations the malloc below makes for its own
+ *           use, such as the mallocs of a realloc that moves its block, are
+ *           not recorded. Requests of all the threads go to the same trace:
+ *           a free is written before the block is freed and an allocation
+ *           after it is made, and a realloc is made and written under the
+ *           lock of the trace, so an address is always freed in the trace
+ *           before it is allocated again.
+ *
+ * Build:  make bench/librecord.so
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BUF_SIZE (1 << 16)
+#define BOOTSTRAP_SIZE (1 << 14)
+#define PATH_SIZE 4096
+
+/* The malloc below the recorder */
+static void *(*real_malloc)(size_t size);
+static void (*real_free)(void *ptr);
+static void *(*real_calloc)(size_t nmemb, size_t size);
+static void *(*real_realloc)(void *ptr, size_t size);
+static int (*real_posix_memalign)(void **memptr, size_t align, size_t size);
+static void *(*real_aligned_alloc)(size_t align, size_t size);
+static void *(*real_memalign)(size_t align, size_t size);
+static void *(*real_valloc)(size_t size);
+static void *(*real_pvalloc)(size_t size);
+
+/* Serves the allocations dlsym makes while the malloc below is looked up */
+static char bootstrap[BOOTSTRAP_SIZE] __attribute__((aligned(16)));
+static size_t bootstrap_used;
+static bool resolving;
+
+static pthread_once_t open_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int trace_fd = -1;
+static bool per_process;
+static char trace_path[PATH_SIZE];
+static char buf[BUF_SIZE];
+static size_t buf_len;
+
+/* Nonzero while a thread is inside the malloc below */
+static __thread int depth __attribute__((tls_model("initial-exec")));
+
+static void resolve(void);
+static void *bootstrap_alloc(size_t size);
+static bool in_bootstrap(void *ptr);
+static void trace_open(void);
+static void trace_flush(void);
+static void trace_put(char op, void *ptr, size_t size, void *new_ptr,
+                      bool has_size);
+static void put_num(uint64_t n, unsigned base);
+static void record_alloc(void *ptr, size_t size);
+static void record_free(void *ptr);
+static void atfork_prepare(void);
+static void atfork_parent(void);
+static void atfork_child(void);
+
+
+/*
+ * malloc: Allocates size bytes with the malloc below and records it
+ */
+void *malloc(size_t size)
+{
+    void *ptr;
+
+    if (real_malloc == NULL)
+    {
+        resolve();
+        if (real_malloc == NULL)
+        {
+            return bootstrap_alloc(size);
+        }
+    }
+
+    depth++;
+    ptr = real_malloc(size);
+    depth--;
+    record_alloc(ptr, size);
+    return ptr;
+}
+
+/*
+ * free: Records the free of ptr and frees it with the malloc below
+ */
+void free(void *ptr)
+{
+    if (ptr == NULL || in_bootstrap(ptr))
+    {
+        return;
+    }
+
+    record_free(ptr);
+    depth++;
+    real_free(ptr);
+    depth--;
+}
+
+/*
+ * calloc: Allocates zeroed memory with the malloc below and records it as a
+ *         malloc
+ */
+void *calloc(size_t nmemb, size_t size)
+{
+    void *ptr;
+
+    if (real_calloc == NULL)
+    {
+        resolve();
+        if (real_calloc == NULL)
+        {
+            // bootstrap is static, so still zero
+            return nmemb == 0 || size <= SIZE_MAX / nmemb ?
+                   bootstrap_alloc(nmemb * size) : NULL;
+        }
+    }
+
+    depth++;
+    ptr = real_calloc(nmemb, size);
+    depth--;
+    record_alloc(ptr, nmemb * size);
+    return ptr;
+}
+
+/*
+ * realloc: Reallocates ptr with the malloc below, recording it as a realloc
+ *          naming the block by its new address, or as a malloc or a free
+ *          when it is one
+ */
+void *realloc(void *ptr, size_t size)
+{
+    void *new_ptr;
+
+    if (ptr == NULL)
+    {
+        return malloc(size);
+    }
+    if (in_bootstrap(ptr))
+    {
+        // Blocks of the bootstrap buffer move to the malloc below
+        new_ptr = malloc(size);
+        if (new_ptr != NULL)
+        {
+            size_t avail = (size_t)(bootstrap + bootstrap_used - (char *)ptr);
+            memcpy(new_ptr, ptr, size < avail ? size : avail);
+        }
+        return new_ptr;
+    }
+    if (depth != 0 || trace_fd < 0)
+    {
+        return real_realloc(ptr, size);
+    }
+
+    // Another thread must not allocate the old address before it is written
+    pthread_mutex_lock(&trace_lock);
+    depth++;
+    new_ptr = real_realloc(ptr, size);
+    depth--;
+    if (new_ptr != NULL)
+    {
+        trace_put('r', ptr, size, new_ptr, true);
+    }
+    else if (size == 0)
+    {
+        trace_put('f', ptr, 0, NULL, false);
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    return new_ptr;
+}
+
+/*
+ * reallocarray: Same as realloc of nmemb * size bytes, failing on overflow
+ */
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    if (nmemb != 0 && size > SIZE_MAX / nmemb)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+/*
+ * posix_memalign: Allocates aligned memory with the malloc below and records
+ *                 it as a malloc
+ */
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    int err;
+
+    resolve();
+    depth++;
+    err = real_posix_memalign(memptr, align, size);
+    depth--;
+    if (err == 0)
+    {
+        record_alloc(*memptr, size);
+    }
+    return err;
+}
+
+/*
+ * aligned_alloc: Same as posix_memalign, returning the memory
+ */
+void *aligned_alloc(size_t align, size_t size)
+{
+    void *ptr;
+
+    resolve();
+    depth++;
+    ptr = real_aligned_alloc(align, size);
+    depth--;
+    record_alloc(ptr, size);
+    return ptr;
+}
+
+/*
+ * memalign: Same as aligned_alloc
+ */
+void *memalign(size_t align, size_t size)
+{
+    void *ptr;
+
+    resolve();
+    depth++;
+    ptr = real_memalign(align, size);
+    depth--;
+    record_alloc(ptr, size);
+    return ptr;
+}
+
+/*
+ * valloc: Same as aligned_alloc, to the page size
+ */
+void *valloc(size_t size)
+{
+    void *ptr;
+
+    resolve();
+    depth++;
+    ptr = real_valloc(size);
+    depth--;
+    record_alloc(ptr, size);
+    return ptr;
+}
+
+/*
+ * pvalloc: Same as valloc, of size rounded up to the page size
+ */
+void *pvalloc(size_t size)
+{
+    void *ptr;
+
+    resolve();
+    depth++;
+    ptr = real_pvalloc(size);
+    depth--;
+    record_alloc(ptr, size);
+    return ptr;
+}
+
+/*
+ * record_init: Registers the fork handlers and flushes the trace at exit
+ */
+__attribute__((constructor))
+static void record_init(void)
+{
+    pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+}
+
+__attribute__((destructor))
+static void record_fini(void)
+{
+    pthread_mutex_lock(&trace_lock);
+    trace_flush();
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * resolve: Looks up the malloc below the recorder. dlsym may itself allocate,
+ *          which is served from the bootstrap buffer meanwhile.
+ */
+static void resolve(void)
+{
+    if (real_malloc != NULL || resolving)
+    {
+        return;
+    }
+
+    resolving = true;
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_valloc = dlsym(RTLD_NEXT, "valloc");
+    real_pvalloc = dlsym(RTLD_NEXT, "pvalloc");
+    // Set last, as the others are used once it is
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    resolving = false;
+}
+
+/*
+ * bootstrap_alloc: Allocates size bytes of the bootstrap buffer, which are
+ *                  never freed. Returns NULL once it is used up.
+ */
+static void *bootstrap_alloc(size_t size)
+{
+    void *ptr;
+
+    size = (size + 15) & ~(size_t)15;
+    if (size > BOOTSTRAP_SIZE - bootstrap_used)
+    {
+        return NULL;
+    }
+    ptr = bootstrap + bootstrap_used;
+    bootstrap_used += size;
+    return ptr;
+}
+
+/*
+ * in_bootstrap: Returns whether ptr is in the bootstrap buffer
+ */
+static bool in_bootstrap(void *ptr)
+{
+    return (char *)ptr >= bootstrap && (char *)ptr < bootstrap + BOOTSTRAP_SIZE;
+}
+
+/*
+ * trace_open: Opens the file named by MM_RECORD, with %p replaced by the
+ *             process id, if it is set
+ */
+static void trace_open(void)
+{
+    const char *name = getenv("MM_RECORD");
+    size_t len = 0;
+
+    if (name == NULL || *name == '\0')
+    {
+        return;
+    }
+
+    per_process = false;
+    for (; *name != '\0' && len + 24 < PATH_SIZE; name++)
+    {
+        if (name[0] == '%' && name[1] == 'p')
+        {
+            // Digits of the process id, written backwards then reversed
+            char digits[24];
+            size_t n = 0;
+            unsigned long pid = (unsigned long)getpid();
+
+            do
+            {
+                digits[n++] = (char)('0' + pid % 10);
+                pid /= 10;
+            } while (pid != 0);
+            while (n != 0)
+            {
+                trace_path[len++] = digits[--n];
+            }
+            per_process = true;
+            name++;
+        }
+        else
+        {
+            trace_path[len++] = *name;
+        }
+    }
+    trace_path[len] = '\0';
+
+    trace_fd = open(trace_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+}
+
+/*
+ * trace_flush: Writes the buffered requests to the trace. Requires the lock
+ *              of the trace to be held.
+ */
+static void trace_flush(void)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (trace_fd >= 0 && done < buf_len)
+    {
+        n = write(trace_fd, buf + done, buf_len - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            // Nothing more can be recorded
+            close(trace_fd);
+            trace_fd = -1;
+            break;
+        }
+        done += (size_t)n;
+    }
+    buf_len = 0;
+}
+
+/*
+ * trace_put: Buffers the request op of ptr, followed by size if has_size and
+ *            by new_ptr if it is not NULL. Requires the lock of the trace to
+ *            be held.
+ */
+static void trace_put(char op, void *ptr, size_t size, void *new_ptr,
+                      bool has_size)
+{
+    // The longest request takes 2 + 19 + 21 + 19 bytes
+    if (BUF_SIZE - buf_len < 64)
+    {
+        trace_flush();
+    }
+
+    buf[buf_len++] = op;
+    buf[buf_len++] = ' ';
+    put_num((uintptr_t)ptr, 16);
+    if (has_size)
+    {
+        buf[buf_len++] = ' ';
+        put_num(size, 10);
+    }
+    if (new_ptr != NULL)
+    {
+        buf[buf_len++] = ' ';
+        put_num((uintptr_t)new_ptr, 16);
+    }
+    buf[buf_len++] = '\n';
+}
+
+/*
+ * put_num: Buffers n in base 10 or 16, the latter with a 0x prefix
+ */
+static void put_num(uint64_t n, unsigned base)
+{
+    char digits[20];
+    size_t len = 0;
+
+    if (base == 16)
+    {
+        buf[buf_len++] = '0';
+        buf[buf_len++] = 'x';
+    }
+    do
+    {
+        digits[len++] = "0123456789abcdef"[n % base];
+        n /= base;
+    } while (n != 0);
+    while (len != 0)
+    {
+        buf[buf_len++] = digits[--len];
+    }
+}
+
+/*
+ * record_alloc: Records the allocation of size bytes at ptr, unless it
+ *               failed or was made by the malloc below for its own use
+ */
+static void record_alloc(void *ptr, size_t size)
+{
+    if (ptr == NULL || depth != 0)
+    {
+        return;
+    }
+    pthread_once(&open_once, trace_open);
+    if (trace_fd < 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    trace_put('a', ptr, size, NULL, true);
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * record_free: Records the free of ptr, unless made by the malloc below
+ */
+static void record_free(void *ptr)
+{
+    if (depth != 0)
+    {
+        return;
+    }
+    pthread_once(&open_once, trace_open);
+    if (trace_fd < 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    trace_put('f', ptr, 0, NULL, false);
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * atfork_prepare: Takes the lock of the trace and flushes it before fork, so
+ *                 the child neither inherits the lock held nor writes the
+ *                 requests of its parent
+ */
+static void atfork_prepare(void)
+{
+    pthread_mutex_lock(&trace_lock);
+    trace_flush();
+}
+
+/*
+ * atfork_parent: Releases the lock of the trace in the parent after fork
+ */
+static void atfork_parent(void)
+{
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * atfork_child: Starts a trace of its own for the child if the name of the
+ *               trace has %p, and stops recording otherwise
+ */
+static void atfork_child(void)
+{
+    if (trace_fd >= 0)
+    {
+        close(trace_fd);
+        trace_fd = -1;
+        if (per_process)
+        {
+            trace_open();
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
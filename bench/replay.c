@@ -0,0 +1,958 @@
+/*
+ * replay.c: Replays allocation traces against the allocator and against the
+ *           system malloc. For each trace and allocator it reports the
+ *           throughput, the peak of the bytes requested and not yet freed,
+ *           the peak heap size, and the utilization, the ratio of the two
+ *           peaks. With -t, it also prints the live bytes, the heap size and
+ *           the fragmentation, the share of the heap not holding live bytes,
+ *           at evenly spaced points of the trace. With -p, it prints the
+ *           instructions, cache, TLB and branch misses per request of the
+ *           timed replays, from the hardware counters (counters.c). With -f,
+ *           mm uses the placement policy given as order,search[,scan], as
+ *           in addr,first or fifo,best,32 (see mm_set_policy). With -s, mm
+ *           serves requests of up to the given size from slabs, 0 for none
+ *           (see mm_set_slab_limit).
+ *
+ *           Each trace is replayed once with checks, which fill every block
+ *           with a pattern and verify it on realloc and free, and measures
+ *           the heap after every request; then rounds more times without
+ *           them, the fastest of which gives the throughput. The allocator
+ *           is reset before each replay: mm by emptying the heap, the system
+ *           malloc by freeing every block and trimming its heap.
+ *
+ *           A trace is a text file with one request per line:
+ *
+ *             a <id> <size>           allocates size bytes as block id
+ *             r <id> <size> [<new>]   reallocates block id to size bytes,
+ *                                     naming it new from then on if given
+ *             f <id>                  frees block id
+ *
+ *           Ids are numbers, decimal or 0x hexadecimal, naming a block from
+ *           its allocation to its free, after which they may be reused; the
+ *           recorder uses addresses. Lines starting with # are comments.
+ *           The header of the course traces, four lines of one number each,
+ *           is skipped, so their traces replay as they are.
+ *
+ * Build:  make bench/replay
+ * Usage:  bench/replay [-a mm|libc|both] [-f policy] [-p] [-r rounds]
+ *                      [-s slab_limit] [-t samples] trace...
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <malloc.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "counters.h"
+
+#define NO_SLOT UINT32_MAX
+
+typedef struct op
+{
+    char type;              // 'a', 'r' or 'f'
+    uint32_t slot;          // slot of the block, ids are mapped to slots
+    size_t size;            // requested size, 0 for frees
+} op_t;
+
+typedef struct trace
+{
+    const char *path;
+    op_t *ops;
+    size_t nops;
+    size_t nslots;          // most blocks live at once
+} trace_t;
+
+typedef struct allocator
+{
+    const char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*reset)(void);
+    size_t (*heap_size)(void);
+} allocator_t;
+
+typedef struct sample
+{
+    size_t op;              // requests replayed
+    size_t live;            // bytes requested and not freed
+    size_t heap;            // heap size
+} sample_t;
+
+typedef struct result
+{
+    double seconds;         // fastest replay
+    size_t peak_live;
+    size_t peak_heap;
+    sample_t *samples;
+} result_t;
+
+/* Maps the ids of a trace to slots while it is loaded */
+typedef struct id_map
+{
+    uint64_t *ids;
+    uint32_t *slots;        // NO_SLOT for empty entries
+    size_t cap;             // power of two
+    size_t count;
+} id_map_t;
+
+static bool parse_policy(const char *s, int *order, int *search,
+                         size_t *scan);
+static void *map_array(void *old, size_t old_bytes, size_t new_bytes);
+static void unmap_array(void *array, size_t bytes);
+static bool load_trace(const char *path, trace_t *t);
+static bool parse_id(char **s, uint64_t *id);
+static bool parse_size(char **s, size_t *size);
+static size_t map_find(const id_map_t *m, uint64_t id);
+static bool map_insert(id_map_t *m, uint64_t id, uint32_t slot);
+static void map_remove(id_map_t *m, size_t i);
+static double replay(const trace_t *t, const allocator_t *al, void **slots);
+static bool replay_checked(const trace_t *t, const allocator_t *al,
+                           void **slots, size_t *sizes, result_t *res,
+                           size_t nsamples);
+static unsigned char pattern(uint32_t slot, size_t i);
+static void fill(void *ptr, size_t size, uint32_t slot);
+static bool check(const void *ptr, size_t size, uint32_t slot, bool last);
+static void free_all(const trace_t *t, const allocator_t *al, void **slots);
+static uint64_t now_ns(void);
+
+static void mm_reset(void);
+static size_t mm_heap_size(void);
+static void libc_reset(void);
+static size_t libc_heap_size(void);
+
+static const allocator_t allocators[] =
+{
+    {"mm", mm_malloc, mm_free, mm_realloc, mm_reset, mm_heap_size},
+    {"libc", malloc, free, realloc, libc_reset, libc_heap_size},
+};
+
+
+int main(int argc, char **argv)
+{
+    const char *which = "both";
+    int rounds = 3;
+    size_t nsamples = 0;
+    double util_sum[2] = {0, 0};
+    double seconds_sum[2] = {0, 0};
+    size_t ops_sum = 0;
+    size_t ntraces = 0;
+    bool use_counters = false;
+    counters_t ctrs;
+    int order = MM_ORDER_FIFO, search = MM_FIT_GOOD;
+    size_t scan = 0;
+    size_t slab_limit = SIZE_MAX;     // left as it is
+    bool ok = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:f:pr:s:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            which = optarg;
+            break;
+        case 'f':
+            ok = ok && parse_policy(optarg, &order, &search, &scan);
+            break;
+        case 'p':
+            use_counters = true;
+            break;
+        case 'r':
+            rounds = atoi(optarg);
+            break;
+        case 's':
+            slab_limit = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            nsamples = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            ok = false;
+            break;
+        }
+    }
+    if (!ok || optind == argc || (strcmp(which, "mm") != 0 &&
+        strcmp(which, "libc") != 0 && strcmp(which, "both") != 0))
+    {
+        fprintf(stderr, "usage: %s [-a mm|libc|both] [-f policy] [-p] "
+                "[-r rounds] [-s slab_limit] [-t samples] trace...\n",
+                argv[0]);
+        return 2;
+    }
+    if (rounds < 1)
+    {
+        rounds = 1;
+    }
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+    mm_set_policy(order, search, scan);
+    if (slab_limit != SIZE_MAX)
+    {
+        mm_set_slab_limit(slab_limit);
+    }
+    if (use_counters)
+    {
+        counters_open(&ctrs);
+    }
+
+    printf("%-24s %-5s %10s %10s %12s %12s %7s\n", "trace", "alloc", "ops",
+           "Kops/s", "peak_live", "peak_heap", "util");
+
+    for (int i = optind; i < argc; i++)
+    {
+        trace_t t;
+        void **slots;
+        size_t *sizes;
+
+        if (!load_trace(argv[i], &t))
+        {
+            return 1;
+        }
+        slots = map_array(NULL, 0, t.nslots * sizeof(*slots));
+        sizes = map_array(NULL, 0, t.nslots * sizeof(*sizes));
+
+        for (size_t k = 0; k < 2; k++)
+        {
+            const allocator_t *al = &allocators[k];
+            result_t res = {0};
+            double util;
+
+            if (strcmp(which, "both") != 0 && strcmp(which, al->name) != 0)
+            {
+                continue;
+            }
+
+            res.samples = map_array(NULL, 0,
+                                    (nsamples + 1) * sizeof(*res.samples));
+            al->reset();
+            if (!replay_checked(&t, al, slots, sizes, &res, nsamples))
+            {
+                fprintf(stderr, "%s: replay against %s failed\n", t.path,
+                        al->name);
+                return 1;
+            }
+            free_all(&t, al, slots);
+
+            res.seconds = 0;
+            if (use_counters)
+            {
+                counters_reset(&ctrs);
+            }
+            for (int r = 0; r < rounds; r++)
+            {
+                double seconds;
+
+                al->reset();
+                if (use_counters)
+                {
+                    counters_start(&ctrs);
+                }
+                seconds = replay(&t, al, slots);
+                if (use_counters)
+                {
+                    counters_stop(&ctrs);
+                }
+                free_all(&t, al, slots);
+                if (r == 0 || seconds < res.seconds)
+                {
+                    res.seconds = seconds;
+                }
+            }
+
+            util = res.peak_heap != 0 ?
+                   (double)res.peak_live / (double)res.peak_heap : 0;
+            util_sum[k] += util;
+            seconds_sum[k] += res.seconds;
+            printf("%-24s %-5s %10zu %10.1f %12zu %12zu %6.1f%%\n",
+                   t.path, al->name, t.nops,
+                   res.seconds > 0 ? (double)t.nops / res.seconds / 1e3 : 0,
+                   res.peak_live, res.peak_heap, 100 * util);
+
+            if (use_counters)
+            {
+                counters_print_header(stdout, "   ");
+                counters_print(stdout, "   ", &ctrs,
+                               (double)t.nops * (double)rounds);
+            }
+            if (nsamples != 0)
+            {
+                printf("    %12s %12s %12s %7s\n", "op", "live", "heap",
+                       "frag");
+            }
+            for (size_t s = 0; s < nsamples; s++)
+            {
+                sample_t *sm = &res.samples[s];
+
+                printf("    %12zu %12zu %12zu %6.1f%%\n", sm->op, sm->live,
+                       sm->heap, sm->heap != 0 ?
+                       100 * (1 - (double)sm->live / (double)sm->heap) : 0);
+            }
+            unmap_array(res.samples, (nsamples + 1) * sizeof(*res.samples));
+        }
+
+        ops_sum += t.nops;
+        ntraces++;
+        unmap_array(slots, t.nslots * sizeof(*slots));
+        unmap_array(sizes, t.nslots * sizeof(*sizes));
+        unmap_array(t.ops, t.nops * sizeof(*t.ops));
+    }
+
+    // Mean utilization, and throughput over all the traces
+    for (size_t k = 0; k < 2; k++)
+    {
+        if (seconds_sum[k] > 0)
+        {
+            printf("%-24s %-5s %10zu %10.1f %12s %12s %6.1f%%\n", "total",
+                   allocators[k].name, ops_sum,
+                   (double)ops_sum / seconds_sum[k] / 1e3, "", "",
+                   100 * util_sum[k] / (double)ntraces);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * parse_policy: Parses a placement policy, order,search[,scan], with order
+ *               fifo, lifo or addr and search good, first, best or next.
+ *               Returns false if it is malformed.
+ */
+static bool parse_policy(const char *s, int *order, int *search,
+                         size_t *scan)
+{
+    static const char *const orders[] = {"fifo", "lifo", "addr"};
+    static const char *const searches[] = {"good", "first", "best", "next"};
+    char name[16];
+    size_t len;
+
+    *order = *search = -1;
+    len = strcspn(s, ",");
+    for (int i = 0; i < 3; i++)
+    {
+        if (len == strlen(orders[i]) && strncmp(s, orders[i], len) == 0)
+        {
+            *order = i;
+        }
+    }
+    if (s[len] != ',')
+    {
+        return false;
+    }
+    s += len + 1;
+    len = strcspn(s, ",");
+    if (len >= sizeof(name))
+    {
+        return false;
+    }
+    memcpy(name, s, len);
+    name[len] = '\0';
+    for (int i = 0; i < 4; i++)
+    {
+        if (strcmp(name, searches[i]) == 0)
+        {
+            *search = i;
+        }
+    }
+    *scan = s[len] == ',' ? strtoul(s + len + 1, NULL, 0) : 0;
+
+    return *order >= 0 && *search >= 0;
+}
+
+/*
+ * map_array: Returns an array of new_bytes bytes holding the first old_bytes
+ *            of old, which is unmapped. Arrays are mapped rather than taken
+ *            from malloc, so that the system malloc only holds the blocks of
+ *            the trace when it is measured. Exits on failure.
+ */
+static void *map_array(void *old, size_t old_bytes, size_t new_bytes)
+{
+    void *array;
+
+    if (new_bytes == 0)
+    {
+        new_bytes = 1;
+    }
+    array = mmap(NULL, new_bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (array == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+    if (old != NULL)
+    {
+        memcpy(array, old, old_bytes);
+        unmap_array(old, old_bytes);
+    }
+    return array;
+}
+
+/*
+ * unmap_array: Unmaps an array returned by map_array
+ */
+static void unmap_array(void *array, size_t bytes)
+{
+    if (array != NULL)
+    {
+        munmap(array, bytes != 0 ? bytes : 1);
+    }
+}
+
+/*
+ * load_trace: Reads the trace at path into t, mapping its ids to slots, the
+ *             slot of a freed block being reused by later allocations.
+ *             Prints an error and returns false if the trace is malformed.
+ */
+static bool load_trace(const char *path, trace_t *t)
+{
+    FILE *f = fopen(path, "r");
+    id_map_t m = {0};
+    uint32_t *free_slots = NULL;
+    size_t nfree = 0;
+    size_t free_cap = 0;
+    size_t ops_cap = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    size_t lineno = 0;
+    size_t header = 0;
+    bool ok = true;
+
+    if (f == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    t->path = path;
+    t->ops = NULL;
+    t->nops = 0;
+    t->nslots = 0;
+
+    while (ok && getline(&line, &line_cap, f) != -1)
+    {
+        char *s = line;
+        uint64_t id, new_id;
+        size_t i;
+        op_t op = {0};
+
+        lineno++;
+        while (isspace((unsigned char)*s))
+        {
+            s++;
+        }
+        if (*s == '\0' || *s == '#')
+        {
+            continue;
+        }
+        // The four lines of the header of the course traces
+        if (t->nops == 0 && header < 4 && isdigit((unsigned char)*s))
+        {
+            header++;
+            continue;
+        }
+
+        op.type = *s++;
+        switch (op.type)
+        {
+        case 'a':
+            if (!parse_id(&s, &id) || !parse_size(&s, &op.size))
+            {
+                fprintf(stderr, "%s:%zu: malformed request\n", path, lineno);
+                ok = false;
+                break;
+            }
+            if (map_find(&m, id) != SIZE_MAX)
+            {
+                fprintf(stderr, "%s:%zu: id %llu is already allocated\n",
+                        path, lineno, (unsigned long long)id);
+                ok = false;
+                break;
+            }
+            if (nfree != 0)
+            {
+                op.slot = free_slots[--nfree];
+            }
+            else
+            {
+                op.slot = (uint32_t)t->nslots++;
+            }
+            ok = map_insert(&m, id, op.slot);
+            break;
+
+        case 'r':
+        case 'f':
+            if (!parse_id(&s, &id) ||
+                (op.type == 'r' && !parse_size(&s, &op.size)))
+            {
+                fprintf(stderr, "%s:%zu: malformed request\n", path, lineno);
+                ok = false;
+                break;
+            }
+            if ((i = map_find(&m, id)) == SIZE_MAX)
+            {
+                fprintf(stderr, "%s:%zu: id %llu is not allocated\n",
+                        path, lineno, (unsigned long long)id);
+                ok = false;
+                break;
+            }
+            op.slot = m.slots[i];
+            map_remove(&m, i);
+
+            if (op.type == 'f')
+            {
+                if (nfree == free_cap)
+                {
+                    free_cap = free_cap != 0 ? 2 * free_cap : 1024;
+                    free_slots = map_array(free_slots,
+                                           nfree * sizeof(*free_slots),
+                                           free_cap * sizeof(*free_slots));
+                }
+                free_slots[nfree++] = op.slot;
+            }
+            else
+            {
+                // The block keeps its slot, under its new id if given
+                if (!parse_id(&s, &new_id))
+                {
+                    new_id = id;
+                }
+                if (map_find(&m, new_id) != SIZE_MAX)
+                {
+                    fprintf(stderr, "%s:%zu: id %llu is already allocated\n",
+                            path, lineno, (unsigned long long)new_id);
+                    ok = false;
+                    break;
+                }
+                ok = map_insert(&m, new_id, op.slot);
+            }
+            break;
+
+        default:
+            fprintf(stderr, "%s:%zu: unknown request '%c'\n", path, lineno,
+                    op.type);
+            ok = false;
+            break;
+        }
+
+        if (!ok)
+        {
+            break;
+        }
+        if (t->nops == ops_cap)
+        {
+            ops_cap = ops_cap != 0 ? 2 * ops_cap : 4096;
+            t->ops = map_array(t->ops, t->nops * sizeof(*t->ops),
+                               ops_cap * sizeof(*t->ops));
+        }
+        t->ops[t->nops++] = op;
+    }
+
+    // Shrink the requests to their number, as main unmaps them by it
+    if (ok)
+    {
+        op_t *ops = map_array(NULL, 0, t->nops * sizeof(*ops));
+        memcpy(ops, t->ops, t->nops * sizeof(*ops));
+        unmap_array(t->ops, ops_cap * sizeof(*t->ops));
+        t->ops = ops;
+    }
+    unmap_array(free_slots, free_cap * sizeof(*free_slots));
+    unmap_array(m.ids, m.cap * sizeof(*m.ids));
+    unmap_array(m.slots, m.cap * sizeof(*m.slots));
+    free(line);
+    fclose(f);
+    return ok;
+}
+
+/*
+ * parse_id: Reads an id from *s, advancing *s past it. Returns false if
+ *           there is none.
+ */
+static bool parse_id(char **s, uint64_t *id)
+{
+    char *end;
+
+    errno = 0;
+    *id = strtoull(*s, &end, 0);
+    if (end == *s || errno != 0)
+    {
+        return false;
+    }
+    *s = end;
+    return true;
+}
+
+/*
+ * parse_size: Reads a size from *s, advancing *s past it. Returns false if
+ *             there is none.
+ */
+static bool parse_size(char **s, size_t *size)
+{
+    uint64_t value;
+
+    if (!parse_id(s, &value))
+    {
+        return false;
+    }
+    *size = (size_t)value;
+    return true;
+}
+
+/*
+ * map_find: Returns the index of id in m, or SIZE_MAX if it is not there
+ */
+static size_t map_find(const id_map_t *m, uint64_t id)
+{
+    size_t i;
+
+    if (m->cap == 0)
+    {
+        return SIZE_MAX;
+    }
+    for (i = (id * 0x9e3779b97f4a7c15ull) & (m->cap - 1);
+         m->slots[i] != NO_SLOT; i = (i + 1) & (m->cap - 1))
+    {
+        if (m->ids[i] == id)
+        {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+/*
+ * map_insert: Adds id, which must not be in m, with its slot. Doubles the
+ *             table when half full. Returns true.
+ */
+static bool map_insert(id_map_t *m, uint64_t id, uint32_t slot)
+{
+    size_t i;
+
+    if (2 * (m->count + 1) > m->cap)
+    {
+        id_map_t grown = {0};
+
+        grown.cap = m->cap != 0 ? 2 * m->cap : 1024;
+        grown.ids = map_array(NULL, 0, grown.cap * sizeof(*grown.ids));
+        grown.slots = map_array(NULL, 0, grown.cap * sizeof(*grown.slots));
+        memset(grown.slots, 0xff, grown.cap * sizeof(*grown.slots));
+        for (i = 0; i < m->cap; i++)
+        {
+            if (m->slots[i] != NO_SLOT)
+            {
+                map_insert(&grown, m->ids[i], m->slots[i]);
+            }
+        }
+        unmap_array(m->ids, m->cap * sizeof(*m->ids));
+        unmap_array(m->slots, m->cap * sizeof(*m->slots));
+        *m = grown;
+    }
+
+    for (i = (id * 0x9e3779b97f4a7c15ull) & (m->cap - 1);
+         m->slots[i] != NO_SLOT; i = (i + 1) & (m->cap - 1))
+        ;
+    m->ids[i] = id;
+    m->slots[i] = slot;
+    m->count++;
+    return true;
+}
+
+/*
+ * map_remove: Removes entry i of m, moving back the entries after it that
+ *             would no longer be found
+ */
+static void map_remove(id_map_t *m, size_t i)
+{
+    size_t mask = m->cap - 1;
+    size_t j = i;
+    size_t home;
+
+    m->slots[i] = NO_SLOT;
+    m->count--;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+        if (m->slots[j] == NO_SLOT)
+        {
+            return;
+        }
+        // Entry j moves to the hole unless its home lies in (i, j]
+        home = (m->ids[j] * 0x9e3779b97f4a7c15ull) & mask;
+        if ((j > i && (home <= i || home > j)) ||
+            (j < i && home <= i && home > j))
+        {
+            m->ids[i] = m->ids[j];
+            m->slots[i] = m->slots[j];
+            m->slots[j] = NO_SLOT;
+            i = j;
+        }
+    }
+}
+
+/*
+ * replay: Replays t against al and returns the time it took in seconds. The
+ *         blocks left allocated by the trace are left in slots.
+ */
+static double replay(const trace_t *t, const allocator_t *al, void **slots)
+{
+    uint64_t start = now_ns();
+    void *ptr;
+
+    for (size_t i = 0; i < t->nops; i++)
+    {
+        const op_t *op = &t->ops[i];
+
+        switch (op->type)
+        {
+        case 'a':
+            slots[op->slot] = al->malloc(op->size);
+            break;
+        case 'r':
+            ptr = al->realloc(slots[op->slot], op->size);
+            if (ptr != NULL || op->size == 0)
+            {
+                slots[op->slot] = ptr;
+            }
+            break;
+        default:
+            al->free(slots[op->slot]);
+            slots[op->slot] = NULL;
+            break;
+        }
+    }
+
+    return (double)(now_ns() - start) / 1e9;
+}
+
+/*
+ * replay_checked: Replays t against al, filling every block and checking its
+ *                 contents on realloc and free, and its alignment. Records in
+ *                 res the peaks of the live bytes and of the heap size, taken
+ *                 after every request, and nsamples samples of them. Returns
+ *                 false, after printing why, if the allocator fails.
+ */
+static bool replay_checked(const trace_t *t, const allocator_t *al,
+                           void **slots, size_t *sizes, result_t *res,
+                           size_t nsamples)
+{
+    size_t live = 0;
+    size_t heap;
+    size_t next = 0;
+    void *ptr;
+
+    res->peak_live = 0;
+    res->peak_heap = 0;
+
+    for (size_t i = 0; i < t->nops; i++)
+    {
+        const op_t *op = &t->ops[i];
+        uint32_t s = op->slot;
+
+        switch (op->type)
+        {
+        case 'a':
+            ptr = al->malloc(op->size);
+            if (ptr == NULL && op->size != 0)
+            {
+                fprintf(stderr, "request %zu: malloc of %zu bytes failed\n",
+                        i, op->size);
+                return false;
+            }
+            fill(ptr, op->size, s);
+            slots[s] = ptr;
+            sizes[s] = op->size;
+            live += op->size;
+            break;
+
+        case 'r':
+            if (!check(slots[s], sizes[s], s, true))
+            {
+                fprintf(stderr, "request %zu: block overwritten\n", i);
+                return false;
+            }
+            ptr = al->realloc(slots[s], op->size);
+            if (ptr == NULL && op->size != 0)
+            {
+                fprintf(stderr, "request %zu: realloc to %zu bytes failed\n",
+                        i, op->size);
+                return false;
+            }
+            if (op->size != 0 &&
+                !check(ptr, sizes[s] < op->size ? sizes[s] : op->size, s,
+                       sizes[s] <= op->size))
+            {
+                fprintf(stderr, "request %zu: realloc lost the data\n", i);
+                return false;
+            }
+            fill(ptr, op->size, s);
+            slots[s] = ptr;
+            live = live - sizes[s] + op->size;
+            sizes[s] = op->size;
+            break;
+
+        default:
+            if (!check(slots[s], sizes[s], s, true))
+            {
+                fprintf(stderr, "request %zu: block overwritten\n", i);
+                return false;
+            }
+            al->free(slots[s]);
+            slots[s] = NULL;
+            live -= sizes[s];
+            sizes[s] = 0;
+            break;
+        }
+
+        if ((uintptr_t)slots[s] % 16 != 0)
+        {
+            fprintf(stderr, "request %zu: %p is not aligned\n", i, slots[s]);
+            return false;
+        }
+
+        heap = al->heap_size();
+        if (live > res->peak_live)
+        {
+            res->peak_live = live;
+        }
+        if (heap > res->peak_heap)
+        {
+            res->peak_heap = heap;
+        }
+
+        // Samples end evenly spaced parts of the trace
+        if (next < nsamples && i + 1 == (next + 1) * t->nops / nsamples)
+        {
+            res->samples[next].op = i + 1;
+            res->samples[next].live = live;
+            res->samples[next].heap = heap;
+            next++;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * pattern: Returns the byte the block of slot holds at offset i
+ */
+static unsigned char pattern(uint32_t slot, size_t i)
+{
+    return (unsigned char)(slot * 7 + i / 256 + i % 256);
+}
+
+/*
+ * fill: Writes the pattern of slot to the block of size bytes at ptr, to one
+ *       byte every 256 and to the last byte
+ */
+static void fill(void *ptr, size_t size, uint32_t slot)
+{
+    unsigned char *p = ptr;
+
+    for (size_t i = 0; i < size; i += 256)
+    {
+        p[i] = pattern(slot, i);
+    }
+    if (size != 0)
+    {
+        p[size - 1] = pattern(slot, size - 1);
+    }
+}
+
+/*
+ * check: Returns whether the first size bytes at ptr hold the pattern of
+ *        slot, checking the byte at size - 1 only if last, that is, if the
+ *        block was filled with size bytes
+ */
+static bool check(const void *ptr, size_t size, uint32_t slot, bool last)
+{
+    const unsigned char *p = ptr;
+
+    for (size_t i = 0; i < size; i += 256)
+    {
+        if (p[i] != pattern(slot, i))
+        {
+            return false;
+        }
+    }
+    return !last || size == 0 || p[size - 1] == pattern(slot, size - 1);
+}
+
+/*
+ * free_all: Frees the blocks t left allocated
+ */
+static void free_all(const trace_t *t, const allocator_t *al, void **slots)
+{
+    for (size_t s = 0; s < t->nslots; s++)
+    {
+        if (slots[s] != NULL)
+        {
+            al->free(slots[s]);
+            slots[s] = NULL;
+        }
+    }
+}
+
+/*
+ * now_ns: Returns a monotonic timestamp in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * mm_reset: Empties the heap of mm
+ */
+static void mm_reset(void)
+{
+    mem_reset_brk();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+}
+
+/*
+ * mm_heap_size: Returns the size of the heap of mm
+ */
+static size_t mm_heap_size(void)
+{
+    return mem_heapsize();
+}
+
+/*
+ * libc_reset: Gives the free memory of the system malloc back, once every
+ *             block of the trace is freed
+ */
+static void libc_reset(void)
+{
+    malloc_trim(0);
+}
+
+/*
+ * libc_heap_size: Returns the memory of the system malloc: its main heap and
+ *                 its mapped chunks
+ */
+static size_t libc_heap_size(void)
+{
+    struct mallinfo2 mi = mallinfo2();
+
+    return mi.arena + mi.hblkhd;
+}
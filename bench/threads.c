@@ -0,0 +1,554 @@
+/*
+ * threads.c: Measures mm and the system malloc under concurrent use, for 1,
+ *            2, 4 and so on up to as many threads as there are cores, and
+ *            reports the throughput and the peak resident set of each run.
+ *            Each run is a process of its own, so that the resident sets of
+ *            the two allocators do not add up.
+ *
+ *            larson      server churn: each thread replaces random blocks of
+ *                        a set of 1000, and the sets move to the next thread
+ *                        every round, so that most frees are of blocks
+ *                        allocated by another thread
+ *            threadtest  private churn: each thread allocates 10000 blocks
+ *                        of 64 bytes and frees them, over and over
+ *            prodcons    handoff: threads in pairs, one allocating blocks
+ *                        and passing them through a ring to the other, which
+ *                        frees them
+ *            false       false sharing: each thread allocates 8 bytes,
+ *                        writes them 1000 times and frees them, over and
+ *                        over; it runs slowly if the blocks of two threads
+ *                        share a cache line. Counts the operations as
+ *                        writes, and reports how many of the lines of the
+ *                        first 64 blocks of each thread hold blocks of more
+ *                        than one thread
+ *
+ *            -c prints comma-separated values for charting.
+ *
+ * Build:  make bench/threads
+ * Usage:  bench/threads [-a mm|libc|both] [-b bench] [-t max threads]
+ *                       [-n work scale] [-c]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define LARSON_SLOTS 1000
+#define LARSON_ROUNDS 20
+#define RING_SIZE 1024
+#define SHARE_BLOCKS 64
+#define LINE_SIZE 64
+
+typedef struct allocator
+{
+    const char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+} allocator_t;
+
+typedef struct worker
+{
+    int id;
+    pthread_t tid;
+    uint64_t seed;
+    uint64_t ops;
+} worker_t;
+
+/* Blocks passed from a producer to a consumer */
+typedef struct ring
+{
+    _Atomic size_t head;
+    char pad[LINE_SIZE - sizeof(size_t)];
+    _Atomic size_t tail;
+    void *ptrs[RING_SIZE];
+} ring_t;
+
+/* What a run reports to the parent */
+typedef struct result
+{
+    double secs;
+    uint64_t ops;
+    uint64_t shared;
+} result_t;
+
+static void *larson(void *arg);
+static void *threadtest(void *arg);
+static void *prodcons(void *arg);
+static void *false_sharing(void *arg);
+
+static const allocator_t allocators[] =
+{
+    {"mm", mm_malloc, mm_free},
+    {"libc", malloc, free},
+};
+
+static const struct
+{
+    const char *name;
+    void *(*thread)(void *arg);
+} benches[] =
+{
+    {"larson", larson},
+    {"threadtest", threadtest},
+    {"prodcons", prodcons},
+    {"false", false_sharing},
+};
+
+/* The state of the run of the child */
+static const allocator_t *al;
+static int nthreads;
+static size_t scale;
+static pthread_barrier_t barrier;
+static void **sets;                 // larson: nthreads sets of blocks
+static ring_t *rings;               // prodcons: one per pair
+static uintptr_t *lines;            // false: the first blocks of each thread
+
+static double now(void);
+static uint64_t rnd(worker_t *w, uint64_t n);
+static void *must_malloc(size_t size);
+static bool run(int bench, const allocator_t *a, int threads,
+                result_t *res, long *rss_kb);
+static result_t run_child(int bench);
+static uint64_t count_shared(void);
+
+
+int main(int argc, char **argv)
+{
+    const char *which = "both";
+    const char *bench_arg = "all";
+    long max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool csv = false;
+    int opt;
+
+    scale = 1;
+    while ((opt = getopt(argc, argv, "a:b:t:n:c")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            which = optarg;
+            break;
+        case 'b':
+            bench_arg = optarg;
+            break;
+        case 't':
+            max_threads = atol(optarg);
+            break;
+        case 'n':
+            scale = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            csv = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-a mm|libc|both] [-b bench] "
+                    "[-t max threads] [-n work scale] [-c]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (max_threads < 1)
+    {
+        max_threads = 1;
+    }
+    if (scale == 0)
+    {
+        scale = 1;
+    }
+
+    if (csv)
+    {
+        printf("bench,alloc,threads,mops,rss_kb,shared\n");
+    }
+    else
+    {
+        printf("%-10s %-5s %7s %10s %10s %7s\n", "bench", "alloc",
+               "threads", "Mops/s", "rss_KiB", "shared");
+    }
+    for (int b = 0; b < (int)(sizeof(benches) / sizeof(benches[0])); b++)
+    {
+        if (strcmp(bench_arg, "all") != 0 &&
+            strcmp(bench_arg, benches[b].name) != 0)
+        {
+            continue;
+        }
+        for (int a = 0; a < 2; a++)
+        {
+            if (strcmp(which, "both") != 0 &&
+                strcmp(which, allocators[a].name) != 0)
+            {
+                continue;
+            }
+            // 1, 2, 4 and so on, and the number of cores last
+            for (long t = 1; t <= max_threads; t = t * 2 > max_threads &&
+                 t != max_threads ? max_threads : t * 2)
+            {
+                result_t res;
+                long rss_kb;
+
+                if (!run(b, &allocators[a], (int)t, &res, &rss_kb))
+                {
+                    fprintf(stderr, "%s with %s on %ld threads failed\n",
+                            benches[b].name, allocators[a].name, t);
+                    return 1;
+                }
+                printf(csv ? "%s,%s,%ld,%.3f,%ld,%llu\n" :
+                       "%-10s %-5s %7ld %10.3f %10ld %7llu\n",
+                       benches[b].name, allocators[a].name, t,
+                       (double)res.ops / res.secs / 1e6, rss_kb,
+                       (unsigned long long)res.shared);
+                fflush(stdout);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * now: Returns a monotonic timestamp in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * rnd: Returns a pseudo-random number below n, from the xorshift generator
+ *      of worker w
+ */
+static uint64_t rnd(worker_t *w, uint64_t n)
+{
+    w->seed ^= w->seed << 13;
+    w->seed ^= w->seed >> 7;
+    w->seed ^= w->seed << 17;
+    return w->seed % n;
+}
+
+/*
+ * must_malloc: Allocates size bytes with the allocator under test, and ends
+ *              the run if it fails
+ */
+static void *must_malloc(size_t size)
+{
+    void *ptr = al->malloc(size);
+
+    if (ptr == NULL)
+    {
+        fprintf(stderr, "malloc of %zu bytes failed\n", size);
+        exit(1);
+    }
+    *(volatile char *)ptr = 1;
+    return ptr;
+}
+
+/*
+ * run: Runs benchmark bench with allocator a on threads threads in a child
+ *      process. Returns false if the child failed; otherwise stores what it
+ *      reported in res and its peak resident set in rss_kb.
+ */
+static bool run(int bench, const allocator_t *a, int threads,
+                result_t *res, long *rss_kb)
+{
+    struct rusage usage;
+    int fds[2];
+    int status;
+    pid_t pid;
+    bool ok;
+
+    if (pipe(fds) != 0)
+    {
+        return false;
+    }
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        result_t r;
+
+        close(fds[0]);
+        al = a;
+        nthreads = threads;
+        r = run_child(bench);
+        _exit(write(fds[1], &r, sizeof(r)) == sizeof(r) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ok = read(fds[0], res, sizeof(*res)) == sizeof(*res);
+    close(fds[0]);
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+    {
+        return false;
+    }
+    *rss_kb = usage.ru_maxrss;
+    return ok;
+}
+
+/*
+ * run_child: Runs benchmark bench on nthreads threads, in the child
+ */
+static result_t run_child(int bench)
+{
+    result_t r = {0, 0, 0};
+    worker_t *workers = calloc((size_t)nthreads, sizeof(*workers));
+    double start;
+
+    mem_init();
+    if (workers == NULL || !mm_init())
+    {
+        fprintf(stderr, "initialization failed\n");
+        exit(1);
+    }
+    sets = calloc((size_t)nthreads * LARSON_SLOTS, sizeof(*sets));
+    rings = aligned_alloc(LINE_SIZE, ((size_t)nthreads / 2 + 1) *
+                          sizeof(*rings));
+    lines = calloc((size_t)nthreads * SHARE_BLOCKS, sizeof(*lines));
+    if (sets == NULL || rings == NULL || lines == NULL)
+    {
+        fprintf(stderr, "initialization failed\n");
+        exit(1);
+    }
+    memset(rings, 0, ((size_t)nthreads / 2 + 1) * sizeof(*rings));
+    pthread_barrier_init(&barrier, NULL, (unsigned)nthreads);
+
+    start = now();
+    for (int i = 0; i < nthreads; i++)
+    {
+        workers[i].id = i;
+        workers[i].seed = 0x9e3779b97f4a7c15ull * (uint64_t)(i + 1);
+        if (pthread_create(&workers[i].tid, NULL, benches[bench].thread,
+                           &workers[i]) != 0)
+        {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_join(workers[i].tid, NULL);
+        r.ops += workers[i].ops;
+    }
+    r.secs = now() - start;
+    r.shared = count_shared();
+    return r;
+}
+
+/*
+ * larson: Replaces random blocks of 16 to 512 bytes of a set, moving on to
+ *         the set of the thread before it every round
+ */
+static void *larson(void *arg)
+{
+    worker_t *w = arg;
+    void **set = &sets[(size_t)w->id * LARSON_SLOTS];
+
+    for (size_t i = 0; i < LARSON_SLOTS; i++)
+    {
+        set[i] = must_malloc(16 + rnd(w, 497));
+    }
+    pthread_barrier_wait(&barrier);
+
+    for (int round = 0; round < LARSON_ROUNDS; round++)
+    {
+        set = &sets[(size_t)((w->id + round) % nthreads) * LARSON_SLOTS];
+        for (size_t i = 0; i < 5000 * scale; i++)
+        {
+            size_t j = (size_t)rnd(w, LARSON_SLOTS);
+
+            al->free(set[j]);
+            set[j] = must_malloc(16 + rnd(w, 497));
+        }
+        w->ops += 2 * 5000 * scale;
+        pthread_barrier_wait(&barrier);
+    }
+
+    for (size_t i = 0; i < LARSON_SLOTS; i++)
+    {
+        al->free(set[i]);
+    }
+    return NULL;
+}
+
+/*
+ * threadtest: Allocates 10000 blocks of 64 bytes and frees them, 10 times
+ */
+static void *threadtest(void *arg)
+{
+    worker_t *w = arg;
+    void **ptrs = calloc(10000, sizeof(*ptrs));
+
+    if (ptrs == NULL)
+    {
+        exit(1);
+    }
+    for (size_t iter = 0; iter < 10 * scale; iter++)
+    {
+        for (size_t i = 0; i < 10000; i++)
+        {
+            ptrs[i] = must_malloc(64);
+        }
+        for (size_t i = 0; i < 10000; i++)
+        {
+            al->free(ptrs[i]);
+        }
+        w->ops += 2 * 10000;
+    }
+    free(ptrs);
+    return NULL;
+}
+
+/*
+ * prodcons: Even threads allocate blocks of 16 to 1024 bytes and pass them
+ *           to the next thread, which frees them. The last thread, if it
+ *           has no pair, frees its own blocks in runs of 64.
+ */
+static void *prodcons(void *arg)
+{
+    worker_t *w = arg;
+    ring_t *ring = &rings[w->id / 2];
+    size_t count = 200000 * scale;
+
+    if (w->id % 2 == 0 && w->id == nthreads - 1)
+    {
+        void *ptrs[64];
+
+        for (size_t i = 0; i < count; i += 64)
+        {
+            for (size_t j = 0; j < 64; j++)
+            {
+                ptrs[j] = must_malloc(16 + rnd(w, 1009));
+            }
+            for (size_t j = 0; j < 64; j++)
+            {
+                al->free(ptrs[j]);
+            }
+        }
+    }
+    else if (w->id % 2 == 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            void *ptr = must_malloc(16 + rnd(w, 1009));
+            size_t tail = atomic_load_explicit(&ring->tail,
+                                               memory_order_relaxed);
+
+            while (tail - atomic_load_explicit(&ring->head,
+                                               memory_order_acquire) ==
+                   RING_SIZE)
+            {
+                sched_yield();
+            }
+            ring->ptrs[tail % RING_SIZE] = ptr;
+            atomic_store_explicit(&ring->tail, tail + 1,
+                                  memory_order_release);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t head = atomic_load_explicit(&ring->head,
+                                               memory_order_relaxed);
+
+            while (atomic_load_explicit(&ring->tail, memory_order_acquire) ==
+                   head)
+            {
+                sched_yield();
+            }
+            al->free(ring->ptrs[head % RING_SIZE]);
+            atomic_store_explicit(&ring->head, head + 1,
+                                  memory_order_release);
+        }
+    }
+    // Pairs count once for each block, for its malloc and its free
+    w->ops += count;
+    return NULL;
+}
+
+/*
+ * false_sharing: Notes where its first 64 blocks of 8 bytes are, then
+ *                allocates 8 bytes, writes them 1000 times and frees them,
+ *                10000 times
+ */
+static void *false_sharing(void *arg)
+{
+    worker_t *w = arg;
+    void *ptrs[SHARE_BLOCKS];
+
+    // All threads allocate their first blocks at the same time
+    pthread_barrier_wait(&barrier);
+    for (size_t i = 0; i < SHARE_BLOCKS; i++)
+    {
+        ptrs[i] = must_malloc(8);
+        lines[(size_t)w->id * SHARE_BLOCKS + i] =
+            (uintptr_t)ptrs[i] / LINE_SIZE;
+    }
+    for (size_t i = 0; i < SHARE_BLOCKS; i++)
+    {
+        al->free(ptrs[i]);
+    }
+
+    for (size_t iter = 0; iter < 10000 * scale; iter++)
+    {
+        volatile char *ptr = must_malloc(8);
+
+        for (int i = 0; i < 1000; i++)
+        {
+            ptr[i % 8]++;
+        }
+        al->free((void *)ptr);
+    }
+    w->ops += 10000 * scale * 1000;
+    return NULL;
+}
+
+/*
+ * count_shared: Returns how many of the cache lines noted by false_sharing
+ *               hold blocks of more than one thread
+ */
+static uint64_t count_shared(void)
+{
+    size_t n = (size_t)nthreads * SHARE_BLOCKS;
+    uint64_t shared = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        bool first = lines[i] != 0;
+        bool other = false;
+
+        // Counts each line once, where it is first noted
+        for (size_t j = 0; j < i && first; j++)
+        {
+            first = lines[j] != lines[i];
+        }
+        for (size_t j = i + 1; j < n && first && !other; j++)
+        {
+            other = lines[j] == lines[i] &&
+                    j / SHARE_BLOCKS != i / SHARE_BLOCKS;
+        }
+        if (first && other)
+        {
+            shared++;
+        }
+    }
+    return shared;
+}
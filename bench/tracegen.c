@@ -0,0 +1,406 @@
+/*
+ * tracegen.c: Writes the synthetic traces of traces/ for bench/replay. Each
+ *             trace stresses one part of the allocator, or follows the shape
+ *             of the requests of a kind of program; the generator is seeded,
+ *             so the traces are the same on every run.
+ *
+ *             binary     small blocks kept between larger freed ones, then
+ *                        blocks slightly larger than the holes
+ *             coalesce   runs of blocks freed in random order, then blocks
+ *                        of twice and four times their size
+ *             random     random sizes up to 16 KiB and random lifetimes
+ *             realloc    buffers grown by realloc, with small blocks
+ *                        allocated after them that are kept
+ *             phases     compiler-like: each phase allocates small objects,
+ *                        keeps a tenth of them and frees the rest in reverse
+ *             server     requests that each allocate a buffer and headers and
+ *                        grow a response, next to a cache of long-lived
+ *                        entries replaced at random
+ *             small      nodes of 8 to 24 bytes and a few short strings, with
+ *                        random lifetimes
+ *
+ * Build:  make bench/tracegen
+ * Usage:  bench/tracegen <directory>, or make traces
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_LIVE 65536
+
+typedef struct gen
+{
+    FILE *f;
+    uint64_t seed;
+    uint64_t next_id;       // ids are never reused
+} gen_t;
+
+static uint64_t rnd(gen_t *g, uint64_t n);
+static size_t rnd_size(gen_t *g, size_t lo, size_t hi);
+static uint64_t put_alloc(gen_t *g, size_t size);
+static void put_realloc(gen_t *g, uint64_t id, size_t size);
+static void put_free(gen_t *g, uint64_t id);
+static void shuffle(gen_t *g, uint64_t *ids, size_t n);
+
+static void gen_binary(gen_t *g);
+static void gen_coalesce(gen_t *g);
+static void gen_random(gen_t *g);
+static void gen_realloc(gen_t *g);
+static void gen_phases(gen_t *g);
+static void gen_server(gen_t *g);
+static void gen_small(gen_t *g);
+
+static const struct
+{
+    const char *name;
+    const char *about;
+    void (*gen)(gen_t *g);
+} traces[] =
+{
+    {"binary", "small blocks kept between freed larger ones, then blocks "
+     "larger than the holes", gen_binary},
+    {"coalesce", "runs of blocks freed in random order, then blocks of twice "
+     "and four times their size", gen_coalesce},
+    {"random", "random sizes up to 16 KiB and random lifetimes", gen_random},
+    {"realloc", "buffers grown by realloc with small blocks kept after them",
+     gen_realloc},
+    {"phases", "phases of small objects, a tenth kept and the rest freed in "
+     "reverse", gen_phases},
+    {"server", "requests with buffers, headers and growing responses, and a "
+     "cache of long-lived entries", gen_server},
+    {"small", "nodes of 8 to 24 bytes and short strings with random "
+     "lifetimes", gen_small},
+};
+
+/* Ids of the blocks live in a generator */
+static uint64_t live[MAX_LIVE];
+
+
+int main(int argc, char **argv)
+{
+    char path[4096];
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <directory>\n", argv[0]);
+        return 2;
+    }
+
+    for (size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++)
+    {
+        gen_t g = {NULL, 0x9e3779b97f4a7c15ull * (i + 1), 1};
+
+        snprintf(path, sizeof(path), "%s/%s.rep", argv[1], traces[i].name);
+        if ((g.f = fopen(path, "w")) == NULL)
+        {
+            perror(path);
+            return 1;
+        }
+        fprintf(g.f, "# %s: %s\n# written by bench/tracegen\n",
+                traces[i].name, traces[i].about);
+        traces[i].gen(&g);
+        if (fclose(g.f) != 0)
+        {
+            perror(path);
+            return 1;
+        }
+        printf("%s\n", path);
+    }
+
+    return 0;
+}
+
+/*
+ * rnd: Returns a pseudo-random number below n, from a xorshift generator
+ */
+static uint64_t rnd(gen_t *g, uint64_t n)
+{
+    g->seed ^= g->seed << 13;
+    g->seed ^= g->seed >> 7;
+    g->seed ^= g->seed << 17;
+    return g->seed % n;
+}
+
+/*
+ * rnd_size: Returns a size between lo and hi, with a logarithmic
+ *           distribution, so that small sizes are the most common
+ */
+static size_t rnd_size(gen_t *g, size_t lo, size_t hi)
+{
+    size_t bits = 0;
+    size_t size;
+
+    while ((hi >> bits) > lo)
+    {
+        bits++;
+    }
+    size = (lo << rnd(g, bits + 1)) + rnd(g, lo);
+    return size < hi ? size : hi;
+}
+
+/*
+ * put_alloc: Writes the allocation of size bytes and returns its id
+ */
+static uint64_t put_alloc(gen_t *g, size_t size)
+{
+    fprintf(g->f, "a %llu %zu\n", (unsigned long long)g->next_id, size);
+    return g->next_id++;
+}
+
+/*
+ * put_realloc: Writes the reallocation of block id to size bytes
+ */
+static void put_realloc(gen_t *g, uint64_t id, size_t size)
+{
+    fprintf(g->f, "r %llu %zu\n", (unsigned long long)id, size);
+}
+
+/*
+ * put_free: Writes the free of block id
+ */
+static void put_free(gen_t *g, uint64_t id)
+{
+    fprintf(g->f, "f %llu\n", (unsigned long long)id);
+}
+
+/*
+ * shuffle: Puts the n ids of ids in random order
+ */
+static void shuffle(gen_t *g, uint64_t *ids, size_t n)
+{
+    for (size_t i = n; i > 1; i--)
+    {
+        size_t j = (size_t)rnd(g, i);
+        uint64_t id = ids[i - 1];
+
+        ids[i - 1] = ids[j];
+        ids[j] = id;
+    }
+}
+
+/*
+ * gen_binary: Writes the binary trace
+ */
+static void gen_binary(gen_t *g)
+{
+    size_t n = 4000;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        live[i] = put_alloc(g, 64);
+        live[n + i] = put_alloc(g, 448);
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        put_free(g, live[n + i]);
+    }
+    for (size_t i = 0; i < n / 2; i++)
+    {
+        live[n + i] = put_alloc(g, 512);
+    }
+    for (size_t i = 0; i < n + n / 2; i++)
+    {
+        put_free(g, live[i]);
+    }
+}
+
+/*
+ * gen_coalesce: Writes the coalesce trace
+ */
+static void gen_coalesce(gen_t *g)
+{
+    size_t n = 2000;
+
+    for (size_t size = 4096; size <= 16384; size *= 2, n /= 2)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            live[i] = put_alloc(g, size - rnd(g, 64));
+        }
+        shuffle(g, live, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            put_free(g, live[i]);
+        }
+    }
+}
+
+/*
+ * gen_random: Writes the random trace
+ */
+static void gen_random(gen_t *g)
+{
+    size_t nlive = 0;
+
+    for (size_t i = 0; i < 40000; i++)
+    {
+        // Allocations win while there are few blocks, frees when many
+        if (nlive == 0 || rnd(g, 4000) >= nlive)
+        {
+            live[nlive++] = put_alloc(g, 1 + rnd(g, 16384));
+        }
+        else
+        {
+            size_t j = (size_t)rnd(g, nlive);
+
+            put_free(g, live[j]);
+            live[j] = live[--nlive];
+        }
+    }
+    while (nlive != 0)
+    {
+        put_free(g, live[--nlive]);
+    }
+}
+
+/*
+ * gen_realloc: Writes the realloc trace
+ */
+static void gen_realloc(gen_t *g)
+{
+    size_t nbufs = 16;
+    size_t sizes[16];
+    size_t nsmall = 0;
+
+    for (size_t b = 0; b < nbufs; b++)
+    {
+        sizes[b] = 512;
+        live[b] = put_alloc(g, sizes[b]);
+    }
+    for (size_t i = 0; i < 1500; i++)
+    {
+        for (size_t b = 0; b < nbufs; b++)
+        {
+            sizes[b] += 16 + rnd(g, 512);
+            put_realloc(g, live[b], sizes[b]);
+            if (rnd(g, 4) == 0)
+            {
+                live[nbufs + nsmall++] = put_alloc(g, 16 + rnd(g, 64));
+            }
+        }
+    }
+    for (size_t i = 0; i < nbufs + nsmall; i++)
+    {
+        put_free(g, live[i]);
+    }
+}
+
+/*
+ * gen_phases: Writes the phases trace
+ */
+static void gen_phases(gen_t *g)
+{
+    size_t kept = 0;
+    size_t base = 40000;    // the objects of a phase follow the kept ones
+
+    for (size_t phase = 0; phase < 8; phase++)
+    {
+        size_t n = 0;
+
+        for (size_t i = 0; i < 4000; i++)
+        {
+            uint64_t id = put_alloc(g, rnd_size(g, 16, 2048));
+
+            if (rnd(g, 10) == 0)
+            {
+                live[kept++] = id;
+            }
+            else
+            {
+                live[base + n++] = id;
+            }
+        }
+        while (n != 0)
+        {
+            put_free(g, live[base + --n]);
+        }
+    }
+    shuffle(g, live, kept);
+    for (size_t i = 0; i < kept; i++)
+    {
+        put_free(g, live[i]);
+    }
+}
+
+/*
+ * gen_server: Writes the server trace
+ */
+static void gen_server(gen_t *g)
+{
+    size_t ncache = 500;
+    uint64_t headers[16];
+
+    for (size_t i = 0; i < ncache; i++)
+    {
+        live[i] = put_alloc(g, rnd_size(g, 64, 8192));
+    }
+
+    for (size_t req = 0; req < 3000; req++)
+    {
+        uint64_t buffer = put_alloc(g, 4096 << rnd(g, 5));
+        size_t nheaders = 4 + (size_t)rnd(g, 12);
+        size_t body = 256;
+        uint64_t response = put_alloc(g, body);
+
+        for (size_t h = 0; h < nheaders; h++)
+        {
+            headers[h] = put_alloc(g, rnd_size(g, 16, 256));
+        }
+        for (size_t step = rnd(g, 6); step != 0; step--)
+        {
+            body *= 2;
+            put_realloc(g, response, body);
+        }
+        // Some requests replace an entry of the cache
+        if (rnd(g, 4) == 0)
+        {
+            size_t j = (size_t)rnd(g, ncache);
+
+            put_free(g, live[j]);
+            live[j] = put_alloc(g, rnd_size(g, 64, 8192));
+        }
+        for (size_t h = 0; h < nheaders; h++)
+        {
+            put_free(g, headers[h]);
+        }
+        put_free(g, response);
+        put_free(g, buffer);
+    }
+
+    for (size_t i = 0; i < ncache; i++)
+    {
+        put_free(g, live[i]);
+    }
+}
+
+/*
+ * gen_small: Writes the small trace
+ */
+static void gen_small(gen_t *g)
+{
+    size_t nlive = 0;
+
+    for (size_t i = 0; i < 200000; i++)
+    {
+        // About 20000 blocks live at a time, one in eight a string
+        if (nlive == 0 || rnd(g, 40000) >= nlive)
+        {
+            size_t size = rnd(g, 8) == 0 ? rnd_size(g, 25, 64) :
+                          8 * (1 + rnd(g, 3)) - rnd(g, 4);
+
+            live[nlive++] = put_alloc(g, size);
+        }
+        else
+        {
+            size_t j = (size_t)rnd(g, nlive);
+
+            put_free(g, live[j]);
+            live[j] = live[--nlive];
+        }
+    }
+    while (nlive != 0)
+    {
+        put_free(g, live[--nlive]);
+    }
+}
@@ -0,0 +1,313 @@
+   /*
+   ************************************************************************
+                                   memlib.c
+            Memory backend of the allocator, on top of mmap
+   ************************************************************************
+   */
+
+/*
+ * Provides the interface of the memlib of the course driver on top of the
+ * virtual memory of the process, so that mm.c can serve the malloc of real
+ * programs, e.g. as the shared library libmm.so loaded with LD_PRELOAD.
+ *
+ * The heap lives in reservations: large ranges of address space mapped with
+ * no access, which cost nothing until used. mem_sbrk moves the break through
+ * the newest reservation, committing memory COMMIT_CHUNK bytes at a time
+ * ahead of it, and decommits it again when the break is lowered. When an
+ * increment does not fit in the rest of the reservation, a new reservation
+ * is made wherever the system places it and the break moves to its start, so
+ * consecutive calls to mem_sbrk may return memory that is not contiguous.
+ * Memory the break moves over is always zero, so that mm.c can skip zeroing
+ * it in calloc.
+ *
+ *   start                      brk          committed                start+size
+ *     | ... heap (committed) ... | (committed) | ... reserved ... |
+ *
+ * Calls must be serialized by the caller; mm.c makes them under sbrk_lock.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "memlib.h"
+
+#define RESERVE_SIZE ((size_t)1 << 36)   // size of a reservation, 64 GiB
+#define RESERVE_MIN ((size_t)1 << 26)    // smallest reservation tried
+#define COMMIT_CHUNK ((size_t)1 << 16)   // memory committed at a time
+#define MAX_RESERVATIONS 256
+
+typedef struct reservation
+{
+    char *start;            // first byte of the reservation
+    size_t size;            // size of the reservation in bytes
+} reservation_t;
+
+/* Reservations, the newest one holds the break */
+static reservation_t reservations[MAX_RESERVATIONS];
+static size_t nreservations;
+/* Current break, in the newest reservation */
+static char *mem_brk;
+/* End of the committed part of the newest reservation */
+static char *mem_committed;
+/* Bytes below the break over all reservations */
+static size_t mem_used;
+
+static bool reserve(size_t size);
+static bool commit(char *end);
+static void decommit(char *start, char *end);
+static size_t round_up(size_t size, size_t n);
+
+/*
+ * mem_init: Makes the first reservation, if not made yet. Called by mem_sbrk
+ *           on first use, so programs need not call it.
+ */
+void mem_init(void)
+{
+    if (nreservations == 0)
+    {
+        reserve(0);
+    }
+}
+
+/*
+ * mem_deinit: Unmaps every reservation, freeing the whole heap
+ */
+void mem_deinit(void)
+{
+    for (size_t i = 0; i < nreservations; i++)
+    {
+        munmap(reservations[i].start, reservations[i].size);
+    }
+    nreservations = 0;
+    mem_brk = NULL;
+    mem_committed = NULL;
+    mem_used = 0;
+}
+
+/*
+ * mem_sbrk: Moves the break by incr bytes, and returns its old value, or the
+ *           start of a new reservation if the increment does not fit in the
+ *           current one. A negative increment lowers the break within the
+ *           current reservation, decommits the memory above it and zeroes
+ *           what stays committed, so that the break moves over zeroes only.
+ *           Returns (void *)-1, with errno set to ENOMEM, on failure.
+ */
+void *mem_sbrk(intptr_t incr)
+{
+    reservation_t *r;
+    char *old;
+
+    if (nreservations == 0 && !reserve(0))
+    {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+    r = &reservations[nreservations - 1];
+
+    if (incr < 0)
+    {
+        if ((size_t)-incr > (size_t)(mem_brk - r->start))
+        {
+            errno = ENOMEM;
+            return (void *)-1;
+        }
+        old = mem_brk;
+        mem_brk += incr;
+        mem_used -= (size_t)-incr;
+        decommit((char *)round_up((size_t)mem_brk, COMMIT_CHUNK),
+                 mem_committed);
+        memset(mem_brk, 0, (size_t)((mem_committed < old ? mem_committed : old)
+                                    - mem_brk));
+        return old;
+    }
+
+    // The increment is served by a new reservation if it does not fit
+    if ((size_t)incr > (size_t)(r->start + r->size - mem_brk) &&
+        !reserve((size_t)incr))
+    {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+
+    if (!commit(mem_brk + incr))
+    {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+
+    old = mem_brk;
+    mem_brk += incr;
+    mem_used += (size_t)incr;
+    return old;
+}
+
+/*
+ * mem_reset_brk: Empties the heap, keeping only the first reservation, all
+ *                of it decommitted
+ */
+void mem_reset_brk(void)
+{
+    if (nreservations == 0)
+    {
+        return;
+    }
+    for (size_t i = 1; i < nreservations; i++)
+    {
+        munmap(reservations[i].start, reservations[i].size);
+    }
+    nreservations = 1;
+    mem_committed = reservations[0].start + reservations[0].size;
+    mem_brk = reservations[0].start;
+    decommit(mem_brk, mem_committed);
+    mem_used = 0;
+}
+
+/*
+ * mem_heap_lo: Returns the first byte of the heap. With several reservations,
+ *              the heap is not contiguous, and this is the start of the first.
+ */
+void *mem_heap_lo(void)
+{
+    return nreservations != 0 ? reservations[0].start : NULL;
+}
+
+/*
+ * mem_heap_hi: Returns the last byte below the break
+ */
+void *mem_heap_hi(void)
+{
+    return mem_brk - 1;
+}
+
+/*
+ * mem_heapsize: Returns the number of bytes of heap below the break, over all
+ *               reservations
+ */
+size_t mem_heapsize(void)
+{
+    return mem_used;
+}
+
+/*
+ * mem_pagesize: Returns the page size of the system
+ */
+size_t mem_pagesize(void)
+{
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * mem_memset: Same as memset
+ */
+void *mem_memset(void *ptr, int value, size_t num)
+{
+    return memset(ptr, value, num);
+}
+
+/*
+ * mem_memcpy: Same as memcpy
+ */
+void *mem_memcpy(void *dst, const void *src, size_t num)
+{
+    return memcpy(dst, src, num);
+}
+
+/*
+ * reserve: Makes a new reservation of at least size bytes, RESERVE_SIZE if
+ *          the system allows it and halving down to RESERVE_MIN otherwise,
+ *          and moves the break to its start. Returns false on failure.
+ */
+static bool reserve(size_t size)
+{
+    size_t want = RESERVE_SIZE;
+    char *start = MAP_FAILED;
+
+    if (nreservations == MAX_RESERVATIONS ||
+        size > SIZE_MAX - COMMIT_CHUNK)
+    {
+        return false;
+    }
+    size = round_up(size, COMMIT_CHUNK);
+
+    for (; start == MAP_FAILED && want >= RESERVE_MIN; want /= 2)
+    {
+        if (want < size)
+        {
+            want = size;
+        }
+        start = mmap(NULL, want, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (want == size)
+        {
+            break;
+        }
+    }
+    if (start == MAP_FAILED)
+    {
+        return false;
+    }
+
+    reservations[nreservations].start = start;
+    reservations[nreservations].size = want;
+    nreservations++;
+    mem_brk = start;
+    mem_committed = start;
+    return true;
+}
+
+/*
+ * commit: Makes the newest reservation accessible up to at least end,
+ *         rounded up to COMMIT_CHUNK. Returns false on failure.
+ */
+static bool commit(char *end)
+{
+    reservation_t *r = &reservations[nreservations - 1];
+    char *limit = r->start + r->size;
+
+    if (end <= mem_committed)
+    {
+        return true;
+    }
+    end = (char *)round_up((size_t)end, COMMIT_CHUNK);
+    if (end > limit)
+    {
+        end = limit;
+    }
+    if (mprotect(mem_committed, (size_t)(end - mem_committed),
+                 PROT_READ | PROT_WRITE) != 0)
+    {
+        return false;
+    }
+    mem_committed = end;
+    return true;
+}
+
+/*
+ * decommit: Gives the memory of [start, end) in the newest reservation back
+ *           to the system and makes it inaccessible again
+ */
+static void decommit(char *start, char *end)
+{
+    if (start >= end)
+    {
+        return;
+    }
+    // Mapping over the range drops its pages and its commit charge
+    if (mmap(start, (size_t)(end - start), PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+             -1, 0) != MAP_FAILED)
+    {
+        mem_committed = start;
+    }
+}
+
+/*
+ * round_up: Rounds size up to next multiple of n
+ */
+static size_t round_up(size_t size, size_t n)
+{
+    return (n * ((size + (n-1)) / n));
+}
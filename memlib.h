@@ -0,0 +1,19 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Memory backend of the allocator, with the interface of the memlib of the
+ * course driver. See memlib.c.
+ */
+
+extern void mem_init(void);
+extern void mem_deinit(void);
+extern void *mem_sbrk(intptr_t incr);
+extern void mem_reset_brk(void);
+extern void *mem_heap_lo(void);
+extern void *mem_heap_hi(void);
+extern size_t mem_heapsize(void);
+extern size_t mem_pagesize(void);
+
+extern void *mem_memset(void *ptr, int value, size_t num);
+extern void *mem_memcpy(void *dst, const void *src, size_t num);
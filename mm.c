@@ -8,7 +8,13 @@
    ************************************************************************  
    */
                                                                      
+#define _GNU_SOURCE
 #include <assert.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +22,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -55,6 +64,16 @@
 #define memcpy mem_memcpy
 #endif /* def DRIVER */
 
+#ifdef DRIVER
+/* aliases of the aligned allocation entry points */
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#define memalign mm_memalign
+#define valloc mm_valloc
+#define pvalloc mm_pvalloc
+#define malloc_usable_size mm_malloc_usable_size
+#endif /* def DRIVER */
+
 /* What is the correct alignment? */
 #define ALIGNMENT 16
 
@@ -77,11 +96,31 @@ static size_t align(size_t x) {
 #define dbg_ensures(...)
 #endif
 
+/*
+ * Compact layout, selected at build time with -DCOMPACT. The list links of a
+ * free block are packed into its first payload word, as offsets of the
+ * payloads they point to from heap_base in 16-byte units: 32 bits for the
+ * next block, and 31 bits shifted over LINK_TAG, which is always set, for the
+ * previous one. A free block of 16 bytes then has room for its links, but not
+ * for a footer: the word in front of the header of the next block having
+ * LINK_TAG set, which a footer never has, tells find_prev that the previous
+ * block is 16 bytes long. Requests of up to 8 bytes take 16-byte blocks, and
+ * splitting leaves 16-byte blocks free rather than as slack, but the heap must
+ * lie within COMPACT_SPAN bytes of its start.
+ */
+#ifdef COMPACT
+#define MIN_BLOCK 16                             // minimum block size
+#else
+#define MIN_BLOCK 32
+#endif
+#define LINK_TAG 0x1                             // set in packed links
+#define COMPACT_SPAN ((size_t)1 << 35)           // bytes 31-bit links reach
+
 /* Basic constants */
 typedef uint64_t word_t;
 static const size_t wsize = sizeof(word_t);   // word, header, footer size (bytes)
 static const size_t dsize = 2*wsize;          // double word size (bytes)
-static const size_t min_block_size = 2*dsize; // Minimum block size
+static const size_t min_block_size = MIN_BLOCK; // Minimum block size
 static const size_t chunksize = (1 << 12);    // requires (chunksize % 16 == 0)
 
 typedef struct block
@@ -103,21 +142,472 @@ typedef struct block
 
 /* Global variables */
 
-/* Size of segregated free list array */
-#define LIMIT 17
+/*
+ * The segregated free lists form a two-level index. The first level splits
+ * block sizes by power of two, the second level splits each power of two
+ * into SL_COUNT equal sub-classes. Blocks smaller than SMALL_BLOCK all map
+ * to first level 0, where each sub-class is exactly 16 bytes wide.
+ */
+#define SL_LOG2 4                     // log2 of sub-classes per first level
+#define SL_COUNT (1 << SL_LOG2)       // sub-classes per first level
+#define FL_SHIFT (SL_LOG2 + 4)        // first level of sizes >= SMALL_BLOCK
+#define SMALL_BLOCK (1 << FL_SHIFT)   // smallest size with its own first level
+#define FL_MAX 48                     // blocks are smaller than 2^FL_MAX bytes
+#define FL_COUNT (FL_MAX - FL_SHIFT + 1)
+
+/*
+ * Free blocks of at least TREE_MIN bytes are kept out of the lists, in a
+ * treap ordered by size then address, whose links take the place of the
+ * list links in the payload and whose priorities are hashes of the block
+ * addresses. find_fit takes the smallest block that fits from it, the
+ * lowest of those of equal size, in O(log n), rather than splitting the
+ * first large block of a list for a medium request.
+ */
+#define TREE_MIN (256 * 1024)         // smallest free block kept in the tree
+
+/*
+ * Placement policy of the lists, set by mm_set_policy or at build time with
+ * -DFIT_ORDER, -DFIT_SEARCH and -DFIT_SCAN. fit_order is where add_free_block
+ * puts a block in its list: at the back, at the front, or in address order.
+ * fit_search is how find_fit picks a block from the list the request maps
+ * to: its head if large enough (good fit), the first that fits, the
+ * smallest that fits, or the first that fits from the block after the last
+ * one taken (next fit), scanning at most fit_scan blocks, before falling
+ * back to the first block of the lists that all fit.
+ */
+#ifndef FIT_ORDER
+#define FIT_ORDER MM_ORDER_FIFO
+#endif
+#ifndef FIT_SEARCH
+#define FIT_SEARCH MM_FIT_GOOD
+#endif
+#ifndef FIT_SCAN
+#define FIT_SCAN 16                   // default blocks scanned by find_fit
+#endif
+
+/*
+ * Quick lists. Blocks of up to QUICK_MAX_BLOCK bytes freed to an arena are
+ * parked in a list of their exact size, linked through their first payload
+ * word, without being coalesced: their header still says allocated, so
+ * their neighbours leave them alone, and the next request of that size pops
+ * one straight back instead of splitting a free block. A list is coalesced
+ * into the free lists in bulk when it grows past quick_limit blocks, and
+ * all of them are when find_fit finds no block, before extend_heap runs.
+ */
+#define QUICK_MAX_BLOCK 2048                  // largest parked block size
+#define QUICK_BINS ((QUICK_MAX_BLOCK - MIN_BLOCK) / 16 + 1) // one per size
+#ifndef QUICK_COUNT
+#define QUICK_COUNT 32                        // default quick_limit
+#endif
+#define QUICK_COUNT_MAX 1024                  // largest quick_limit
+
+/*
+ * Arenas. Each arena has its own lock, its own segregated free lists and its
+ * own heap regions, so that threads assigned to different arenas do not
+ * contend. A region is a contiguous part of the heap obtained from mem_sbrk:
+ *
+ *   region     region+16         region+24                      end-8
+ *     | REGION_T | PROLOGUE_FOOTER | ... blocks ... | EPILOGUE_HEADER |
+ *
+ * An arena grows its newest region in place while that region ends at the
+ * break, and starts a new region otherwise. Regions of different arenas never
+ * share a page, so the page map finds the arena owning a block from its
+ * address.
+ *
+ * Blocks freed by threads not assigned to the owning arena are pushed onto a
+ * lock-free queue of the arena instead. The queue is drained, coalescing its
+ * blocks under the arena lock, by the next malloc served by the arena, or by
+ * the pushing thread once the queue holds REMOTE_THRESHOLD blocks and the
+ * arena lock is free.
+ */
+#define MAX_ARENAS 64
+#define REMOTE_THRESHOLD 64
+
+/*
+ * Slabs. Requests of up to slab_limit bytes are served from page-sized slabs
+ * holding objects of a single size class, with no per-object header:
+ *
+ *   slab       slab+64                                        slab+4096
+ *     | SLAB_T | OBJECT 0 | OBJECT 1 | ... | OBJECT count-1 | (unused) |
+ *
+ * Slabs are carved SLAB_SPAN at a time out of a single allocated block of
+ * the arena whose payload is page-aligned. The block is exactly SLAB_SPAN
+ * pages long, so consecutive spans tile the heap, and the last slab of a span
+ * leaves its final word to the header of the next block. The pages of a span
+ * are flagged in the page map, so free recognizes a slab object, and finds
+ * its slab by masking the address down to the page.
+ */
+#define SLAB_SIZE 4096                       // size of a slab, one page
+#define SLAB_HEADER 64                       // offset of the first object
+#define SLAB_SPAN 8                          // slabs carved at a time
+#define SLAB_MAX 512                         // largest possible slab_limit
+#define SLAB_LIMIT 256                       // default slab_limit
+#define SLAB_CLASSES (SLAB_MAX / 16)         // one class per 16 bytes
+#define SLAB_MAP_WORDS ((SLAB_SIZE - SLAB_HEADER) / 16 / 64 + 1)
+
+/*
+ * Mapped chunks. Requests of at least mmap_threshold bytes get an anonymous
+ * mapping of their own, which free returns to the system right away:
+ *
+ *   base          header-8   header     header+8                base+length
+ *     | (padding) | OFFSET  | HEADER   | ... PAYLOAD ...           |
+ *
+ * The header holds the length of the mapping and has the MAPPED flag set,
+ * the word in front of it holds the offset of the header in the mapping.
+ * Mapped chunks are not part of any region, and the page map holds 0 for
+ * their pages. Freeing a chunk larger than the threshold raises the threshold
+ * to the length of the chunk, up to MMAP_THRESHOLD_MAX, so that a size
+ * allocated over and over is served from the heap instead of being mapped
+ * and unmapped every time.
+ *
+ * Chunks of at least MMAP_HUGE bytes are mapped in multiples of MMAP_HUGE,
+ * which the kernel places on huge page boundaries. realloc resizes them with
+ * mremap, which then moves whole page table entries, at a cost independent
+ * of the length of the chunk.
+ */
+#define MAPPED 0x4                               // header flag of mapped chunks
+#define MMAP_THRESHOLD (128 * 1024)              // default mmap_threshold
+#define MMAP_THRESHOLD_MAX (32 * 1024 * 1024)    // largest adapted threshold
+#define MMAP_HUGE (2 * 1024 * 1024)              // huge page size
+
+/*
+ * Returning memory. Free blocks of at least PURGE_MIN bytes are stamped with
+ * the purge epoch of their arena when they enter the free lists. Every
+ * PURGE_TICKS frees, an arena checks the clock, and once purge_decay_ms have
+ * passed since its last pass, it releases the memory of the blocks stamped
+ * before the current epoch, i.e. that have stayed free for at least that
+ * long, and starts a new epoch. The last block before the break is given
+ * back by lowering the break, keeping TRIM_PAD bytes, the others have the
+ * pages inside them, past their list links, released with MADV_DONTNEED and
+ * get the PURGED flag, so they are not released again. Rewriting the header
+ * of a block, when it is allocated, split or coalesced, drops the flag. The
+ * bit is that of SAMPLED, which only allocated blocks carry: place checks
+ * that the block it allocates does not keep it, and free_block clears it.
+ */
+#define PURGED 0x8                               // header flag of free blocks
+#define PURGE_MIN (64 * 1024)                    // smallest block released
+#define PURGE_TICKS 1024                         // frees between clock checks
+#define PURGE_DECAY_MS 10000                     // default purge_decay_ms
+#define TRIM_PAD (64 * 1024)                     // bytes kept by decay trims
+
+/*
+ * Zeroing. calloc only zeroes the part of its block that may hold old data.
+ * New mappings are zero, and so are the pages purge_block released and, with
+ * the memlib of this repository (SBRK_ZEROES), the memory the break moves
+ * over. alloc_block_zero reports the part of a block carved from such memory
+ * that the allocator has not written since, i.e. past the list links and
+ * before the footer. The rest is zeroed by storing bytes, except that the
+ * whole pages of a range of at least CALLOC_REMAP bytes are released with
+ * MADV_DONTNEED and come back as zero pages when first touched.
+ */
+#define CALLOC_REMAP (4 * 1024 * 1024)           // smallest range remapped
+
+/*
+ * Heap profile. While profile_rate is not 0, each thread counts down the
+ * bytes it requests from an interval drawn from an exponential distribution
+ * of mean profile_rate, and the request that reaches 0 is sampled: its call
+ * stack is recorded, and it gets a block of its own, never a slab object or
+ * a cached block, whose header has the SAMPLED flag, so that free finds it
+ * and drops it from the live samples. A request of size bytes is sampled
+ * with probability 1 - exp(-size / profile_rate), which pprof undoes from
+ * the rate written in the profile. Samples and call stacks are kept in
+ * open-addressing tables mapped on first use and protected by profile_lock,
+ * which nests inside the arena locks. The flag shares its bit with PURGED,
+ * which only free blocks carry, so free_block clears it before the block
+ * joins a quick list or the free lists.
+ */
+#define SAMPLED 0x8                   // header flag of sampled allocated blocks
+#define PROFILE_RATE (512 * 1024)     // default mean bytes between samples
+#define PROFILE_DEPTH 32              // deepest call stack recorded
+#define PROFILE_STACKS (1 << 14)      // slots for call stacks, 3/4 used at most
+#define PROFILE_SAMPLE_BITS 16        // log2 of the slots for live samples,
+#define PROFILE_SAMPLES (1 << PROFILE_SAMPLE_BITS) // 1/2 used at most
+
+typedef struct slab
+{
+    struct slab *next;      // next slab of the partial or empty list
+    struct slab *prev;      // previous slab of the partial or empty list
+    struct slab *span;      // first slab of the span the slab belongs to
+    uint16_t live;          // first slab of a span: non-empty slabs in span
+    uint16_t size;          // object size, 0 while the slab is empty
+    uint16_t used;          // number of allocated objects
+    uint16_t count;         // number of objects
+    uint64_t freemap[SLAB_MAP_WORDS]; // bit i is set when object i is free
+} slab_t;
+
+typedef struct profile_stack
+{
+    uint64_t hash;          // 0 for an unused slot
+    uint32_t depth;         // number of return addresses in pcs
+    void *pcs[PROFILE_DEPTH];
+    size_t live_count;      // samples of the stack not freed yet
+    size_t live_bytes;
+    size_t total_count;     // samples of the stack ever taken
+    size_t total_bytes;
+} profile_stack_t;
+
+typedef struct profile_sample
+{
+    void *ptr;              // payload of the sampled block, NULL if unused
+    size_t size;            // bytes requested
+    uint32_t stack;         // index of the call stack in profile_stacks
+} profile_sample_t;
+
+typedef struct region
+{
+    struct region *next;    // next older region of the same arena
+    size_t size;            // size of the region in bytes
+} region_t;
+
+/*
+ * Statistics. Each arena counts, under its lock, the bytes and blocks of its
+ * free lists per first level, which add_free_block and remove_free_block
+ * keep up to date, the blocks parked in its quick lists, its slab spans and
+ * slab objects in use, and the calls to extend_heap, coalesce and the splits
+ * of place. mm_stats adds them up over the arenas, with the sizes of the
+ * regions and the largest free block, which it finds from the bitmaps.
+ */
+typedef struct arena_stats
+{
+    size_t free_bytes[FL_COUNT];  // bytes of the free blocks of a first level
+    size_t free_blocks[FL_COUNT]; // number of free blocks of a first level
+    size_t slab_spans;            // spans carved and not given back
+    size_t slab_bytes;            // bytes of the slab objects in use
+    size_t slab_objects;          // number of slab objects in use
+    size_t extend_calls;          // calls to extend_heap
+    size_t coalesce[4];           // calls to coalesce, per case
+    size_t splits;                // blocks split by place
+    size_t quick_bytes;           // bytes of the blocks in the quick lists
+    size_t quick_blocks;          // number of blocks in the quick lists
+} arena_stats_t;
+
+/*
+ * Heap checks. mm_check runs the checks of a level on each arena under its
+ * lock: MM_CHECK_CHEAP checks the heads and tails of the free lists against
+ * the bitmaps in O(FL_COUNT * SL_COUNT), MM_CHECK_MEDIUM also walks the free
+ * lists and slabs in O(free blocks), and MM_CHECK_FULL also walks every
+ * block of the regions in O(heap). Incremental checks, set by mm_set_check
+ * or MM_CHECK, run every check_interval frees and allocations of an arena,
+ * under its lock: the cheap checks, then the checks of single blocks on the
+ * next check_slice blocks from a cursor, which coalesce moves back to the
+ * start of the block it fell into. A failed incremental check aborts.
+ */
+#define CHECK_SLICE 64                // default blocks per incremental check
+
+typedef struct arena
+{
+    pthread_mutex_t lock;                     // protects the arena
+    block_t *free_listp[FL_COUNT][SL_COUNT];  // first block of each free list
+    block_t *free_back[FL_COUNT][SL_COUNT];   // last block of each free list
+    uint64_t fl_bitmap;       // bit fl is set when first level fl is non-empty
+    uint32_t sl_bitmap[FL_COUNT]; // bit sl is set when free_listp[fl][sl] is
+                                  // non-empty
+    block_t *tree;            // root of the tree of free blocks >= TREE_MIN
+    block_t *rover;           // listed block next fit resumes from, or NULL
+    block_t *quick[QUICK_BINS];         // parked blocks, per size
+    uint16_t quick_count[QUICK_BINS];   // number of blocks of each quick list
+    region_t *regions;        // regions of the arena, newest first
+    block_t *epilogue;        // epilogue header of the newest region
+    uint8_t id;               // index of the arena in arenas
+    slab_t *slab_partial[SLAB_CLASSES]; // slabs with free objects, per class
+    slab_t *slab_empty;       // empty slabs, of any class
+    size_t slab_nempty;       // number of slabs in slab_empty
+    uint64_t purge_epoch;     // stamp of blocks freed since the last pass
+    uint64_t purge_time;      // time of the last purge pass, in ms
+    uint32_t purge_ticks;     // frees since the clock was last checked
+    arena_stats_t stats;      // counters of the arena
+    size_t check_ticks;       // operations since the last incremental check
+    region_t *check_region;   // region of check_cursor
+    block_t *check_cursor;    // next block of the incremental check, or NULL
+    /* Blocks freed by other threads, on their own cache line */
+    void *remote_head __attribute__((aligned(64)));
+    size_t remote_count;      // approximate number of blocks in remote_head
+} __attribute__((aligned(64))) arena_t;
+
 /* Pointer to first block */
 static block_t *heap_listp = NULL;
-/* Pointer to array of seg list */
-static block_t *free_listp[LIMIT];
-/* Pointer to array of pointers to the back of each free_list */
-static block_t *free_back[LIMIT];
+/* All arenas, only the first narenas are assigned to new threads */
+static arena_t arenas[MAX_ARENAS] =
+    { [0 ... MAX_ARENAS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER } };
+static size_t narenas;
+/* Assign arenas by the CPU a thread runs on rather than round-robin */
+static bool arena_by_cpu;
+/* Round-robin counter of arena assignments */
+static size_t next_arena;
+/* Arena the calling thread is assigned to */
+static __thread arena_t *thread_arena
+    __attribute__((tls_model("initial-exec")));
+/* Serializes lazy initialization of the heap */
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Protects mem_sbrk and the page map, nests inside arena locks */
+static pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Incremented by every mm_init, so that thread caches can drop stale blocks */
+static unsigned long heap_gen;
+#ifdef COMPACT
+/* Start of the first reservation of memlib, the base of packed links */
+static char *heap_base;
+#endif
+
+/* Requests of up to slab_limit bytes are served from slabs */
+static size_t slab_limit = SLAB_LIMIT;
+
+/* Requests of at least mmap_threshold bytes are mapped, SIZE_MAX for none */
+#ifdef DRIVER
+// The driver requires every payload to lie in the memlib heap
+static size_t mmap_threshold = SIZE_MAX;
+#else
+static size_t mmap_threshold = MMAP_THRESHOLD;
+#endif
+/* Raise mmap_threshold to the length of freed chunks */
+static bool mmap_dynamic = true;
+/* Number and bytes of the mapped chunks, updated atomically */
+static size_t mapped_chunks;
+static size_t mapped_bytes;
+
+/* Free blocks are released after purge_decay_ms, never if negative */
+#ifdef DRIVER
+static long purge_decay_ms = -1;
+#else
+static long purge_decay_ms = PURGE_DECAY_MS;
+#endif
+
+/* The memlib of the driver cannot lower the break */
+#ifdef DRIVER
+#define SBRK_SHRINKS false
+#else
+#define SBRK_SHRINKS true
+#endif
+
+/* The memlib of the driver may hand out memory the break moved over before */
+#ifdef DRIVER
+#define SBRK_ZEROES false
+#else
+#define SBRK_ZEROES true
+#endif
+
+/*
+ * Page map. Holds, for every page of the heap, the id + 1 of the arena
+ * owning it, and 0 for pages outside of the heap. PM_SLAB is set for the
+ * pages of slabs. Second level tables are mapped on first use and are never
+ * released.
+ */
+#define PM_PAGE_SHIFT 12
+#define PM_PAGE ((size_t)1 << PM_PAGE_SHIFT)
+#define PM_ADDR_BITS 48
+#define PM_L2_BITS 20
+#define PM_L1_BITS (PM_ADDR_BITS - PM_PAGE_SHIFT - PM_L2_BITS)
+#define PM_SLAB 0x80                  // page belongs to a slab
+#define PM_ARENA 0x7f                 // arena id + 1 of the page
+
+static uint8_t *pagemap[1 << PM_L1_BITS];
+
+/*
+ * Per-thread cache. Freed slab objects, and blocks of up to TCACHE_MAX_BLOCK
+ * bytes, stay allocated and are kept in a thread-local singly linked list
+ * per size, so the common malloc/free pair takes no lock and does not touch
+ * the shared free lists. Each list is refilled from, and flushed back to, the
+ * arena half its capacity at a time. The first SLAB_CLASSES bins hold slab
+ * objects, one per slab class, the others one per block size from the
+ * minimum.
+ */
+#define TCACHE_MAX_BLOCK 1024                    // largest cached block size
+#define TCACHE_BINS (SLAB_CLASSES + (TCACHE_MAX_BLOCK - MIN_BLOCK) / 16 + 1)
+#define TCACHE_COUNT 16                          // default capacity of a bin
+#define TCACHE_COUNT_MAX 1024                    // largest capacity of a bin
+
+typedef struct tcache
+{
+    void *bins[TCACHE_BINS];        // first cached payload of each bin
+    uint16_t count[TCACHE_BINS];    // number of cached blocks in each bin
+    unsigned long gen;              // heap_gen the cached blocks belong to
+    bool registered;                // thread exit destructor is installed
+    bool disabled;                  // thread is exiting, bypass the cache
+} tcache_t;
+
+static __thread tcache_t tcache __attribute__((tls_model("initial-exec")));
+/* Capacity of each bin, 0 disables caching for that block size */
+static uint16_t tcache_capacity[TCACHE_BINS] =
+    { [0 ... TCACHE_BINS - 1] = TCACHE_COUNT };
+/* Key whose destructor drains the cache of an exiting thread */
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+/* Installs the fork handlers once */
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+/* Mean bytes between sampled requests, 0 when not sampling */
+static size_t profile_rate;
+/* Rate written in profiles, kept once sampling stops */
+static size_t profile_last_rate = PROFILE_RATE;
+/* Protects the tables of the profile, nests inside arena locks */
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static profile_stack_t *profile_stacks;
+static profile_sample_t *profile_samples;
+static size_t profile_nstacks;
+static size_t profile_nsamples;     // live samples, and slots reserved
+/* Set by the signal of mm_profile_signal, the next sample writes a profile */
+static volatile sig_atomic_t profile_pending;
+static char profile_prefix[256];
+static unsigned profile_seq;
+/* Placement policy of the lists */
+static int fit_order = FIT_ORDER;
+static int fit_search = FIT_SEARCH;
+static size_t fit_scan = FIT_SCAN;
+/* Blocks a quick list parks before they are coalesced, 0 for none */
+static size_t quick_limit = QUICK_COUNT;
+/* Operations of an arena between incremental checks, 0 for none */
+static size_t check_interval;
+/* Blocks checked by each incremental check */
+static size_t check_slice = CHECK_SLICE;
+/* Reads MM_CHECK once */
+static pthread_once_t check_once = PTHREAD_ONCE_INIT;
+/* Reads MM_PROFILE once */
+static pthread_once_t profile_once = PTHREAD_ONCE_INIT;
+/* Bytes the calling thread requests before its next sample */
+static __thread size_t profile_left __attribute__((tls_model("initial-exec")));
+static __thread uint64_t profile_seed
+    __attribute__((tls_model("initial-exec")));
+/* The calling thread is sampling, so its nested requests are not sampled */
+static __thread bool profile_busy __attribute__((tls_model("initial-exec")));
 
 
 /* Function prototypes for internal helper routines */
-static block_t *extend_heap(size_t size);
-static void place(block_t *block, size_t asize);
-static block_t *find_fit(size_t asize);
-static block_t *coalesce(block_t *block);
+static bool init_heap(void);
+static void init_once(void);
+static void *aligned_malloc(size_t align, size_t size);
+static void atfork_init(void);
+static void atfork_prepare(void);
+static void atfork_release(void);
+static size_t adjust_size(size_t size);
+static block_t *alloc_block(arena_t *a, size_t asize);
+static block_t *alloc_block_zero(arena_t *a, size_t asize, char **lo,
+                                 char **hi);
+static void zero_range(char *lo, char *hi);
+static block_t *alloc_aligned_block(arena_t *a, size_t align, size_t asize);
+static size_t alloc_block_batch(arena_t *a, size_t asize, size_t n,
+                                void **ptrs);
+static int ptr_cmp(const void *x, const void *y);
+static void *arena_alloc(arena_t *a, size_t size);
+static void arena_free(arena_t *a, void *ptr);
+static size_t usable_size(void *ptr);
+static void *mmap_alloc(size_t align, size_t size);
+static void mmap_free(block_t *block);
+static void *mmap_resize(block_t *block, size_t size);
+static size_t mmap_length(size_t size);
+static void free_block(arena_t *a, block_t *block);
+static void merge_block(arena_t *a, block_t *block);
+static block_t *extend_heap(arena_t *a, size_t size);
+static bool linkable(const char *lo, const char *hi);
+static void place(arena_t *a, block_t *block, size_t asize);
+static void split_block(arena_t *a, block_t *block, size_t asize);
+static bool resize_block(block_t *block, size_t asize);
+static bool at_break(arena_t *a);
+static size_t arena_trim(arena_t *a, size_t pad);
+static size_t arena_purge(arena_t *a, bool all);
+static void arena_decay(arena_t *a);
+static size_t purge_block(block_t *block);
+static block_t *find_fit(arena_t *a, size_t asize);
+static block_t *list_fit(arena_t *a, block_t *head, size_t asize);
+static block_t *coalesce(arena_t *a, block_t *block);
 
 static size_t max(size_t x, size_t y);
 static size_t round_up(size_t size, size_t n);
@@ -133,8 +623,6 @@ static bool get_alloc(block_t *block);
 static block_t *payload_to_header(void *bp);
 static void *header_to_payload(block_t *block);
 
-static void write_header(block_t *block, size_t size, bool alloc);
-static void write_footer(block_t *block, size_t size, bool alloc);
 static void write_header_new(block_t *block, size_t size, bool alloc, bool alloc_prev);
 static void write_footer_new(block_t *block, size_t size, bool alloc, bool alloc_prev);
 
@@ -142,628 +630,3989 @@ static block_t *find_next(block_t *block);
 static word_t *find_prev_footer(block_t *block);
 static block_t *find_prev(block_t *block);
 
-static size_t free_index(size_t asize);
-void static add_free_block(block_t* block);
-void static remove_free_block(block_t* block);
+static size_t fls_index(size_t x);
+static void free_index(size_t asize, size_t *fl, size_t *sl);
+static bool fit_index(size_t asize, size_t *fl, size_t *sl);
+void static add_free_block(arena_t *a, block_t* block);
+void static remove_free_block(arena_t *a, block_t* block);
 static block_t *get_prev(block_t* block);
 static block_t *get_next(block_t* block);
+static void set_prev(block_t* block, block_t* prev);
+static void set_next(block_t* block, block_t* next);
+#ifdef COMPACT
+static word_t link_offset(block_t *block);
+static block_t *link_block(word_t offset);
+#endif
 
 static bool get_prev_alloc(block_t *block);
 static void set_prev_alloc(block_t *block, bool alloc);
+static bool get_mapped(block_t *block);
+static bool get_purged(block_t *block);
+static uint64_t get_epoch(block_t *block);
+static void set_epoch(block_t *block, uint64_t epoch);
+
+static bool quick_push(arena_t *a, block_t *block);
+static block_t *quick_pop(arena_t *a, size_t asize);
+static void quick_flush_list(arena_t *a, size_t bin);
+static bool quick_flush(arena_t *a);
+
+static block_t **tree_child(block_t *block, bool right);
+static uint64_t tree_priority(block_t *block);
+static bool tree_less(block_t *x, block_t *y);
+static void tree_insert(arena_t *a, block_t *block);
+static void tree_remove(arena_t *a, block_t *block);
+static block_t *tree_fit(arena_t *a, size_t asize);
+static size_t tree_purge(arena_t *a, block_t *node, bool all);
+
+static bool tcache_bin(size_t size, size_t *bin);
+static bool tcache_free_bin(void *ptr, size_t *bin);
+static tcache_t *tcache_get(void);
+static void tcache_key_init(void);
+static void tcache_destroy(void *arg);
+static void tcache_refill(tcache_t *tc, size_t bin);
+static void tcache_flush(tcache_t *tc, size_t bin, size_t keep);
+static void tcache_push(tcache_t *tc, size_t bin, void *ptr);
+
+static void *slab_alloc(arena_t *a, size_t cls);
+static size_t slab_alloc_batch(arena_t *a, size_t cls, size_t n, void **ptrs);
+static void slab_free(arena_t *a, void *ptr);
+static slab_t *slab_new(arena_t *a, size_t size);
+static bool slab_span(arena_t *a);
+static void slab_release(arena_t *a, slab_t *slab);
+static void slab_push(slab_t **list, slab_t *slab);
+static void slab_unlink(slab_t **list, slab_t *slab);
+static slab_t *slab_of(void *ptr);
+
+static arena_t *arena_get(void);
+static arena_t *arena_of(const void *p);
+static void arena_reset(arena_t *a);
+static void remote_free(arena_t *a, void *ptr);
+static void remote_drain(arena_t *a);
+static block_t *region_first_block(region_t *region);
+
+static uint8_t pagemap_get(const void *p);
+static bool pagemap_reserve(const void *start, const void *end);
+static void pagemap_set(const void *start, const void *end, uint8_t val);
+
+static bool get_sampled(block_t *block);
+static bool profile_tick(size_t size);
+static size_t profile_interval(size_t rate);
+static void *profile_alloc(size_t size) __attribute__((noinline));
+static void profile_free(void *ptr);
+static bool profile_stack_index(void **pcs, int depth, uint32_t *index);
+static size_t profile_home(const void *ptr);
+static size_t profile_find(const void *ptr);
+static void profile_reset(void);
+static void profile_env_init(void);
+static void profile_signal_handler(int signo);
+static void profile_dump_next(void);
+static bool profile_put(int fd, char *buf, size_t *len, const char *fmt, ...);
 
 static bool correct_block(block_t *block);
+static void check_report(const char *fmt, ...);
+static bool check_block(arena_t *a, block_t *block);
+static bool check_tree(arena_t *a, block_t *node, block_t *lo, block_t *hi,
+                       uint64_t priority, size_t *nbytes, size_t *nblocks);
+static bool check_lists(arena_t *a, bool walk);
+static bool check_slabs(arena_t *a);
+static bool check_quick(arena_t *a);
+static bool check_arena(arena_t *a, int level);
+static void check_step(arena_t *a);
+static void check_merged(arena_t *a, block_t *block);
+static void check_env_init(void);
 bool mm_checkheap(int lineno);
 
 
 /*
- * mm_init: initializes the heap; it is run once when heap_start == NULL.
- *          prior to any extend_heap operation, this is the heap:
- *              start            start+8           start+16
- *          INIT: | PROLOGUE_FOOTER | EPILOGUE_HEADER |
- * heap_listp ends up pointing to the epilogue header.
+ * mm_init: initializes the heap; it is run once when heap_listp == NULL, and
+ *          must not run concurrently with other calls. Resets every arena and
+ *          creates the first region of arena 0 with a free block of
+ *          chunksize bytes. heap_listp ends up pointing to that block.
  */
 bool mm_init(void) 
 {
+    bool ok;
 
-    size_t index;
-    
-    // Initializing segregated free list array 
-    for (index = 0; index < LIMIT; index++) {
-        free_listp[index] = NULL;
-    }
-    // Initializing back pointers to each each free list
-    for (index = 0; index < LIMIT; index++) {
-        free_back[index] = NULL;
-    }
-
-    // Create the initial empty heap
-    word_t *start = (word_t *)(mem_sbrk(2*wsize));
-
-    if (start == (void *)-1) 
-    {
-        return false;
-    }
-
-    start[0] = pack(0, true); // Prologue footer
-    start[1] = (pack(0, true))|0x2; // Epilogue header
-
-    // Heap starts with first block header (epilogue)
-    heap_listp = (block_t *) &(start[1]);
-    
-    // Extend the empty heap with a free block of chunksize bytes
-    if (extend_heap(chunksize/dsize) == NULL)
-    {
-        return false;
-    }
-
-    return true;
+    pthread_mutex_lock(&init_lock);
+    ok = init_heap();
+    pthread_mutex_unlock(&init_lock);
 
+    return ok;
 }
 
 /*
  * malloc: allocates a block with size at least (size + wsize), rounded up to
- *         the nearest 16 bytes, with a minimum of 2*dsize. Seeks a
- *         sufficiently-large unallocated block on the heap to be allocated.
- *         If no such block is found, extends heap by the maximum between
- *         chunksize and (size + wsize) rounded up to the nearest 16 bytes,
- *         and then attempts to allocate all, or a part of, that memory.
- *         Returns NULL on failure, otherwise returns a pointer to such block.
- *         The allocated block will not be used for further allocations until
- *         freed.
+ *         the nearest 16 bytes, with a minimum of MIN_BLOCK, or an object of a
+ *         slab if size is at most slab_limit. Small requests are served from
+ *         the thread cache, which is refilled in batches when empty. Requests
+ *         of at least mmap_threshold bytes are mapped on their own, falling
+ *         back to the heap if mmap fails. Otherwise seeks a sufficiently-large
+ *         unallocated block on the heap of the thread's arena, extending the
+ *         heap if no such block is found. Returns NULL on failure, otherwise
+ *         returns a pointer to such block. The allocated block will not be
+ *         used for further allocations until freed. While the heap is
+ *         profiled, the requests that are sampled go to profile_alloc.
  */
 void *malloc (size_t size) 
 {
  
-    size_t asize; //Adjusted block size
-    size_t extendsize; //Amount to extend heap if no fit found
-    block_t *block;
+    size_t bin;
+    tcache_t *tc;
+    arena_t *a;
     void *bp = NULL;
 
-    if (heap_listp == NULL) // Initialize heap if it isn't initialized
+    init_once();
+
+    if (size == 0) // Ignore spurious request
     {
-        mm_init();
+#ifdef DRIVER
+        return bp;
+#else
+        // Real programs take NULL for running out of memory
+        size = 1;
+#endif
     }
 
-    if (size == 0) // Ignore spurious request
+    if (__builtin_expect(__atomic_load_n(&profile_rate, __ATOMIC_RELAXED) != 0,
+                         0) && profile_tick(size) &&
+        (bp = profile_alloc(size)) != NULL)
     {
         return bp;
     }
 
-    // Adjust block size to include overhead (header) and to meet alignment requirements
-    if (size <= 24)
-        asize = 32;
-    else 
-        asize = round_up(size+8,16); 
-  
-    // Search the free list for a fit
-    block = find_fit(asize);
+    // Small requests are served from the thread cache without taking the lock
+    if (tcache_bin(size, &bin) && (tc = tcache_get()) != NULL)
+    {
+        if (tc->count[bin] == 0)
+        {
+            tcache_refill(tc, bin);
+            if (tc->count[bin] == 0) // the heap could not be extended
+            {
+                return bp;
+            }
+        }
+        bp = tc->bins[bin];
+        tc->bins[bin] = *(void **)bp;
+        tc->count[bin]--;
+        return bp;
+    }
 
-    if (block == NULL)
+    // Large requests get a mapping of their own
+    if (size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
     {
-        extendsize = max(asize, chunksize);
-        block = extend_heap(extendsize);
-        if (block == NULL) // extend_heap returns an error
+        bp = mmap_alloc(ALIGNMENT, size);
+        if (bp != NULL)
         {
             return bp;
         }
     }
 
-    place(block, asize);
-    bp = header_to_payload(block);
+    a = arena_get();
+    pthread_mutex_lock(&a->lock);
+    remote_drain(a);
+    bp = arena_alloc(a, size);
+    pthread_mutex_unlock(&a->lock);
+
     return bp;
 }
 
 /*
- * free: Frees the block such that it is no longer allocated while still
- *       maintaining its size. Block will be available for use on malloc.
- *       Creates a new header footer for the free block, including the allocation
- *       status of the previous block. Then set the allocation bit of the next block 
- *       to 0
+ * free: Frees the block or slab object such that it is no longer allocated.
+ *       Small ones are kept in the thread cache, flushing half of it to the
+ *       heap when it is full. Sampled blocks are dropped from the profile.
+ *       Mapped chunks are unmapped. Others are returned by arena_free if the
+ *       calling thread uses the arena owning them, and queued on that arena
+ *       otherwise.
  */
 void free (void *ptr) 
 {
-    
+    size_t bin;
+    tcache_t *tc;
+
     if (ptr == NULL)
     {
         return;
     }
 
-    block_t *block = payload_to_header(ptr);
-    size_t size = get_size(block);
+    if (tcache_free_bin(ptr, &bin) && (tc = tcache_get()) != NULL)
+    {
+        tcache_push(tc, bin, ptr);
+        return;
+    }
 
-    //Getting the alloc status of the previous block
-    bool prev_alloc = get_prev_alloc(block);
-    
-    //Making sure the new free block reflects the status of the previous block
-    write_header_new(block, size, false, prev_alloc);
-    write_footer_new(block, size, false, prev_alloc);
+    // Sampled blocks leave the profile; freeing rewrites their header
+    if (profile_samples != NULL && !(pagemap_get(ptr) & PM_SLAB) &&
+        get_sampled(payload_to_header(ptr)))
+    {
+        profile_free(ptr);
+    }
 
-    //Setting the next block prev alloc tag to false
-    block_t* next = find_next(block);
-    set_prev_alloc(next, false);
-    
-    coalesce(block);
+    // Mapped chunks are not in the page map, and are never cached
+    if (pagemap_get(ptr) == 0 && get_mapped(payload_to_header(ptr)))
+    {
+        mmap_free(payload_to_header(ptr));
+        return;
+    }
 
-    return;
+    arena_t *a = arena_of(ptr);
+    if (a != arena_get())
+    {
+        remote_free(a, ptr);
+        return;
+    }
 
+    pthread_mutex_lock(&a->lock);
+    arena_free(a, ptr);
+    pthread_mutex_unlock(&a->lock);
 }
 
 /*
- * realloc: returns a pointer to an allocated region of at least size bytes:
- *          if ptrv is NULL, then call malloc(size);
- *          if size == 0, then call free(ptr) and returns NULL;
- *          else allocates new region of memory, copies old data to new memory,
- *          and then free old block. Returns old block if realloc fails or
- *          returns new pointer on success.
+ * mm_free_sized: Frees ptr, returned by malloc, calloc or realloc, given a
+ *                size between the size requested and the usable size of ptr.
+ *                Small ones go to the thread cache bin derived from the size,
+ *                without reading the header of the block or the slab.
  */
-void *realloc(void *oldptr, size_t size) 
+void mm_free_sized(void *ptr, size_t size)
 {
-    block_t *block = payload_to_header(oldptr);
-    size_t copysize;
-    void *newptr;
+    size_t bin;
+    tcache_t *tc;
+    uint8_t entry;
 
-    // If size == 0, then free block and return NULL
-    if (size == 0)
+    if (ptr == NULL)
     {
-        free(oldptr);
-        return NULL;
+        return;
     }
+    dbg_assert(size != 0 && size <= usable_size(ptr));
 
-    // If ptr is NULL, then equivalent to malloc
-    if (oldptr == NULL)
+    entry = pagemap_get(ptr);
+    if ((entry & PM_SLAB) && size != 0 && size <= SLAB_MAX)
     {
-        return malloc(size);
+        dbg_assert(round_up(size, 16) == slab_of(ptr)->size);
+        bin = (size - 1) / 16;
     }
-
-    // Otherwise, proceed with reallocation
-    newptr = malloc(size);
-    // If malloc fails, the original block is left untouched
-    if (!newptr)
+    else if (entry != 0 && !(entry & PM_SLAB) && size > slab_limit &&
+             adjust_size(size) <= TCACHE_MAX_BLOCK &&
+             !(profile_samples != NULL && get_sampled(payload_to_header(ptr))))
     {
-        return NULL;
+        // The block may be up to 16 bytes larger than the size implies, which
+        // a request served from this bin does not mind
+        bin = SLAB_CLASSES + (adjust_size(size) - min_block_size) / 16;
     }
-
-    // Copy the old data
-    copysize = get_payload_size(block); // gets size of old payload
-    if(size < copysize)
+    else
     {
-        copysize = size;
+        free(ptr);
+        return;
     }
-    memcpy(newptr, oldptr, copysize);
 
-    // Free the old block
-    free(oldptr);
-
-    return newptr;
+    if (tcache_capacity[bin] != 0 && (tc = tcache_get()) != NULL)
+    {
+        tcache_push(tc, bin, ptr);
+        return;
+    }
+    free(ptr);
 }
 
 /*
- * calloc: Allocates a block with size at least (elements * size + dsize)
- *         through malloc, then initializes all bits in allocated memory to 0.
- *         Returns NULL on failure.
+ * mm_malloc_batch: Allocates n objects of size bytes at once, storing them in
+ *                  ptrs, under a single acquisition of the arena lock. Slab
+ *                  objects are taken straight from the bitmaps of their slabs,
+ *                  blocks are carved one after the other out of a single free
+ *                  block. Returns the number of objects allocated, which is
+ *                  less than n only if memory ran out.
  */
-void *calloc (size_t nmemb, size_t size) {
-    void *bp;
-    size_t asize = nmemb * size;
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+    arena_t *a;
+    size_t got = 0;
 
-    if (asize/nmemb != size)
-    // Multiplication overflowed
-    return NULL;
-    
-    bp = malloc(asize);
-    if (bp == NULL)
+    init_once();
+
+    if (size == 0 || n == 0)
     {
-        return NULL;
+        return 0;
     }
-    // Initialize all bits to 0
-    memset(bp, 0, asize);
 
-    return bp;
-}
+    // Large requests are mapped one by one
+    if (size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+    {
+        for (; got < n && (ptrs[got] = malloc(size)) != NULL; got++)
+            ;
+        return got;
+    }
 
-/********** START OF HELPER FUNCTIONS *********/
+    a = arena_get();
+    pthread_mutex_lock(&a->lock);
+    remote_drain(a);
+    if (size <= slab_limit)
+    {
+        got = slab_alloc_batch(a, (size - 1) / 16, n, ptrs);
+    }
+    else
+    {
+        got = alloc_block_batch(a, adjust_size(size), n, ptrs);
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    return got;
+}
 
 /*
- * extend_heap: Extends the heap with the requested number of bytes, and
- *              recreates epilogue header. Returns a pointer to the result of
- *              coalescing the newly-created block with previous free block, if
- *              applicable, or NULL in failure.
+ * mm_free_batch: Frees the n objects of ptrs, which may be NULL, at once.
+ *                Mapped chunks are freed as they come, and objects of other
+ *                arenas are queued on them as free does. The slab objects of
+ *                the arena of the calling thread are freed as they come too,
+ *                its blocks are moved to the front of ptrs and sorted by
+ *                address, so that each run of blocks adjacent on the heap is
+ *                joined into one free block before entering the free lists.
+ *                The arena is locked once. The contents of ptrs are not
+ *                preserved.
  */
-static block_t *extend_heap(size_t size) 
+void mm_free_batch(void **ptrs, size_t n)
 {
-    void *bp;
-    // Allocate an even number of words to maintain alignment
-    size = round_up(size, dsize);
+    arena_t *a = NULL;
+    bool locked = false;
+    block_t *block;
+    size_t nblocks = 0;
+    size_t size;
+    uint8_t entry;
+    size_t i;
 
-    if ((bp = mem_sbrk(size)) == (void *)-1)
+    for (i = 0; i < n; i++)
     {
-        return NULL;
+        void *ptr = ptrs[i];
+        if (ptr == NULL)
+        {
+            continue;
+        }
+        if (a == NULL)
+        {
+            a = arena_get();
+        }
+
+        entry = pagemap_get(ptr);
+        if (profile_samples != NULL && !(entry & PM_SLAB) &&
+            get_sampled(payload_to_header(ptr)))
+        {
+            profile_free(ptr);
+        }
+        if (entry == 0)
+        {
+            mmap_free(payload_to_header(ptr));
+        }
+        else if (arena_of(ptr) != a)
+        {
+            remote_free(arena_of(ptr), ptr);
+        }
+        else if (entry & PM_SLAB)
+        {
+            if (!locked)
+            {
+                pthread_mutex_lock(&a->lock);
+                locked = true;
+            }
+            slab_free(a, ptr);
+        }
+        else
+        {
+            ptrs[nblocks++] = ptr;
+        }
     }
-    
-    // Initialize free block header/footer 
-    block_t *block = payload_to_header(bp);
-    write_header_new(block, size, false, true);
-    write_footer_new(block, size, false, true);
 
-    // Create new epilogue header
-    block_t *block_next = find_next(block);
-    write_header_new(block_next, 0, true, false);
+    // Blocks from mm_malloc_batch often come in order already
+    for (i = 1; i < nblocks && ptrs[i - 1] < ptrs[i]; i++)
+        ;
+    if (i < nblocks)
+    {
+        qsort(ptrs, nblocks, sizeof(*ptrs), ptr_cmp);
+    }
 
-    // Coalesce in case the previous block was free
-    return coalesce(block);
-}
+    if (nblocks != 0 && !locked)
+    {
+        pthread_mutex_lock(&a->lock);
+        locked = true;
+    }
 
+    i = 0;
+    while (i < nblocks)
+    {
+        block = payload_to_header(ptrs[i++]);
 
-/* Coalesce: Coalesces current block with previous and next blocks if
- *           either or both are unallocated; otherwise the block is not
- *           modified. Then, insert coalesced block into the segregated list.
- *           Returns pointer to the coalesced block. After coalescing, the
- *           immediate contiguous previous and next blocks must be allocated.
- */
-static block_t *coalesce(block_t * block) 
-{
-    
-    block_t *block_next = find_next(block);
+        // The blocks following this one in ptrs and on the heap join it
+        size = get_size(block);
+        while (i < nblocks &&
+               ptrs[i] == header_to_payload((block_t *)((char *)block + size)))
+        {
+            size += get_size(payload_to_header(ptrs[i++]));
+        }
+        write_header_new(block, size, true, get_prev_alloc(block));
+        check_merged(a, block);
+        free_block(a, block);
+    }
 
-    // Find the allocation satus of the prev block
-    bool prev_alloc = get_prev_alloc(block);
-    bool next_alloc = get_alloc(block_next);
+    if (locked)
+    {
+        pthread_mutex_unlock(&a->lock);
+    }
+}
 
-    // If the previous block is not allocated, then the prev block has a footer
-    // and we can find the previous block
-    block_t *block_prev = NULL;
-    if (prev_alloc==false)
-        block_prev = find_prev(block);
+/*
+ * malloc_usable_size: Returns the number of bytes usable at ptr, which may
+ *                     be more than requested, or 0 if ptr is NULL
+ */
+size_t malloc_usable_size(void *ptr)
+{
+    return ptr != NULL ? usable_size(ptr) : 0;
+}
 
-    size_t size = get_size(block);
-    
-    /* Case 1 - Next and previous blocks are allocated, just add the block 
-       to a free list */
-    if (prev_alloc && next_alloc)              
+/*
+ * mm_malloc_at_least: Allocates at least size bytes like malloc, and stores
+ *                     in *actual, if not NULL, the number of bytes usable,
+ *                     including the slack of the size class or block
+ */
+void *mm_malloc_at_least(size_t size, size_t *actual)
+{
+    void *bp = malloc(size);
+
+    if (actual != NULL)
     {
-        
-        add_free_block(block);
-        return block;
+        *actual = bp != NULL ? usable_size(bp) : 0;
     }
-    /* Case 2 - Prev block is allocated, next block is free */
-    else if (prev_alloc && !next_alloc)       
+    return bp;
+}
+
+/*
+ * mm_tcache_set_capacity: Sets how many freed blocks each thread caches for
+ *                         the size class that serves requests of size bytes.
+ *                         A count of 0 disables caching for that size class.
+ *                         Returns false if such requests are never cached.
+ */
+bool mm_tcache_set_capacity(size_t size, size_t count)
+{
+    size_t bin;
+
+    if (size == 0 ||
+        (size > slab_limit && adjust_size(size) > TCACHE_MAX_BLOCK))
     {
-        size += get_size(block_next);
-        remove_free_block(block_next);
-        write_header_new(block, size, false, true);
-        write_footer_new(block, size, false, true);
-        add_free_block(block);
+        return false;
     }
-    /* Case 3 - Prev block is free and next block is allocated */
-    else if (!prev_alloc && next_alloc)        
-    {
-        //getting alloc status of prev block of prev block 
-        bool prev_alloc_1 = get_prev_alloc(block_prev);
+    tcache_bin(size, &bin);
+    tcache_capacity[bin] = (uint16_t)(count < TCACHE_COUNT_MAX ?
+                                      count : TCACHE_COUNT_MAX);
+    return true;
+}
 
-        size += get_size(block_prev);
-        
-        remove_free_block(block_prev);
-    
-        write_header_new(block_prev, size, false, prev_alloc_1);
-        write_footer_new(block, size, false, prev_alloc_1);
+/*
+ * mm_set_slab_limit: Sets the largest request served from slabs, rounded up
+ *                    to 16 bytes and at most SLAB_MAX, 0 disables slabs.
+ *                    Objects already allocated from slabs are unaffected.
+ */
+void mm_set_slab_limit(size_t size)
+{
+    slab_limit = size < SLAB_MAX ? round_up(size, 16) : SLAB_MAX;
+}
 
-        block = block_prev;
-        add_free_block(block); 
-    }
-    
-    /* Case 4 - next and prev blocks are free */
-    else                                       
-    {
-        //getting the alloc status of prev block of prev block
-        bool prev_alloc_1 = get_prev_alloc(block_prev);
+/*
+ * mm_set_quick: Sets how many freed blocks of a size each arena parks in its
+ *               quick list before coalescing them, at most QUICK_COUNT_MAX,
+ *               0 to coalesce every block as it is freed. The blocks already
+ *               parked are coalesced.
+ */
+void mm_set_quick(size_t count)
+{
+    quick_limit = count < QUICK_COUNT_MAX ? count : QUICK_COUNT_MAX;
 
-        size += get_size(block_next) + get_size(block_prev);
+    for (size_t i = 0; i < MAX_ARENAS; i++)
+    {
+        arena_t *a = &arenas[i];
+        pthread_mutex_lock(&a->lock);
+        quick_flush(a);
+        pthread_mutex_unlock(&a->lock);
+    }
+}
 
-        remove_free_block(block_prev);
-        remove_free_block(block_next);
-        write_header_new(block_prev, size, false, prev_alloc_1);
-        write_footer_new(block_next, size, false, prev_alloc_1);
-        
-        block = block_prev;
-        add_free_block(block);
-        
+/*
+ * mm_set_policy: Sets the placement policy of the free lists: the order of
+ *                each list, MM_ORDER_FIFO, MM_ORDER_LIFO or MM_ORDER_ADDRESS,
+ *                how find_fit searches the list a request maps to,
+ *                MM_FIT_GOOD, MM_FIT_FIRST, MM_FIT_BEST or MM_FIT_NEXT, and
+ *                how many blocks it scans, FIT_SCAN if scan is 0. Lists keep
+ *                the order of the blocks already in them, so the policy is
+ *                best set before the first allocation. Returns false for an
+ *                unknown order or search.
+ */
+bool mm_set_policy(int order, int search, size_t scan)
+{
+    if (order < MM_ORDER_FIFO || order > MM_ORDER_ADDRESS ||
+        search < MM_FIT_GOOD || search > MM_FIT_NEXT)
+    {
+        return false;
     }
-    return block;
+    fit_order = order;
+    fit_search = search;
+    fit_scan = scan != 0 ? scan : FIT_SCAN;
+    return true;
 }
 
 /*
- * place: Places block with size of asize at the start of bp. If the remaining
- *        size is at least the minimum block size, then split the block to the
- *        the allocated block and the remaining block as free, which is then
- *        inserted into the segregated list. Requires that the block is
- *        initially unallocated.
+ * posix_memalign: Stores in *memptr a pointer to size bytes whose address is
+ *                 a multiple of align, a power of two multiple of the size of
+ *                 a pointer. Returns 0 on success, EINVAL for an invalid
+ *                 alignment and ENOMEM on failure, leaving *memptr untouched.
  */
-static void place(block_t *block, size_t asize)
+int posix_memalign(void **memptr, size_t align, size_t size)
 {
-   
+    void *bp;
 
-    size_t csize = get_size(block);
+    if (align % sizeof(void *) != 0 || (align & (align - 1)) != 0 ||
+        align == 0)
+    {
+        return EINVAL;
+    }
 
-    if ((csize - asize) >= min_block_size)
+    bp = aligned_malloc(align, size);
+    if (bp == NULL && size != 0)
     {
-        //Get state of prev block
-        bool prev_alloc = get_prev_alloc(block);
-        
-        remove_free_block(block);
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
 
-        //Writing only the header of the new allocated block
-        write_header_new(block, asize, true, prev_alloc);
+/*
+ * aligned_alloc: Allocates size bytes whose address is a multiple of align,
+ *                a power of two. Returns NULL on failure, with errno set to
+ *                EINVAL for an invalid alignment.
+ */
+void *aligned_alloc(size_t align, size_t size)
+{
+    if (align == 0 || (align & (align - 1)) != 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    return aligned_malloc(align, size);
+}
 
-        //Getting the next alloc block
-        block = find_next(block);
-        
-        //Writing the header and footer of the new free block
-        write_header_new(block, csize-asize, false, true);
-        write_footer_new(block, csize-asize, false, true);
-        
-        //Adding the remaing part of the block to the free list
-        add_free_block(block);
+/*
+ * memalign: Allocates size bytes whose address is a multiple of align,
+ *           rounded up to a power of two as glibc does. Returns NULL on
+ *           failure.
+ */
+void *memalign(size_t align, size_t size)
+{
+    size_t pow2 = ALIGNMENT;
 
+    if (align > SIZE_MAX / 2)
+    {
+        errno = EINVAL;
+        return NULL;
     }
-    /* Come here if exact size is found */
-    else
+    while (pow2 < align)
     {
-        bool prev_alloc = get_prev_alloc(block);
-        write_header_new(block, csize, true, prev_alloc);
-        remove_free_block(block);
+        pow2 *= 2;
     }
+    return aligned_malloc(pow2, size);
 }
 
 /*
- * find_fit: Looks for a free block with at least asize bytes with
- *           first-fit policy. Returns NULL if none is found.
+ * valloc: Allocates size bytes aligned to the page size
  */
-static block_t *find_fit(size_t asize)
+void *valloc(size_t size)
 {
-    // Find the index at which the block might exist 
-    size_t index = free_index(asize);
-    block_t * block;
-    
-    /* Starting from index iterate through the each free list of the segregated 
-    list to find the block */
-    for(size_t i = index; i < LIMIT; i++)
+    return aligned_malloc(mem_pagesize(), size);
+}
+
+/*
+ * pvalloc: Allocates size bytes, rounded up to whole pages, aligned to the
+ *          page size
+ */
+void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    if (size > SIZE_MAX - page)
     {
-      for (block = free_listp[i]; block!=NULL ; block = get_next(block))
-      {
-        if (asize <= get_size(block))
-        {
+        return NULL;
+    }
+    return aligned_malloc(page, round_up(size != 0 ? size : 1, page));
+}
 
-            return block;
-        }
-      }
+/*
+ * mm_trim: Gives the free memory at the end of the heap back to the system,
+ *          keeping pad bytes free at the end of each arena. Where the break
+ *          cannot be lowered, the pages of that memory are released instead.
+ *          Returns true if any memory was released.
+ */
+bool mm_trim(size_t pad)
+{
+    bool released = false;
+
+    for (size_t i = 0; i < MAX_ARENAS; i++)
+    {
+        arena_t *a = &arenas[i];
+        pthread_mutex_lock(&a->lock);
+        remote_drain(a);
+        quick_flush(a);
+        released |= arena_trim(a, pad) != 0;
+        pthread_mutex_unlock(&a->lock);
     }
-    return NULL; // no fit found
 
+    return released;
 }
 
 /*
- * add_free_block: Adds the free block to appropriate free list. Free block are added 
- *                  to the back of each free list 
- */                  
-void static add_free_block(block_t* block)
+ * mm_purge: Releases the pages inside every free block of at least PURGE_MIN
+ *           bytes right away, regardless of how long it has been free.
+ *           Returns the number of bytes released.
+ */
+size_t mm_purge(void)
 {
-    // Finding the free_list to which to add the free block
-    size_t index = free_index(get_size(block));
-    
-    word_t* temp = (word_t*)block;
-    word_t* temp_free = (word_t*)free_back[index];
-    
-    // Specifying the next block that the current block is free
-    block_t* next = find_next(block);
-    set_prev_alloc(next,false);
+    size_t released = 0;
 
-    /* When adding a free block for the first time, the next and prev block pointers 
-       are NULL and the back and front pointers point to the newly added block */
-    if (free_listp[index] == NULL && free_back[index] == NULL)
+    for (size_t i = 0; i < MAX_ARENAS; i++)
     {
-        temp[2] = 0;
-        temp[1] = 0;
-        free_listp[index] = block;
-        free_back[index] = block;
+        arena_t *a = &arenas[i];
+        pthread_mutex_lock(&a->lock);
+        remote_drain(a);
+        quick_flush(a);
+        released += arena_purge(a, true);
+        pthread_mutex_unlock(&a->lock);
     }
-    
-    /* Else just add the block to the back of the list and let the back pointer point
-       to the newly added block. Set the next pointer to NULL and set the prev pointer 
-       to point to the old last block */
-    else
+
+    return released;
+}
+
+/*
+ * mm_set_decay: Sets how long, in milliseconds, a large free block stays
+ *               free before its memory is released, negative for never
+ */
+void mm_set_decay(long ms)
+{
+    purge_decay_ms = ms;
+}
+
+/*
+ * mm_set_mmap_threshold: Sets the smallest request served by a mapping of its
+ *                        own, 0 for none, and whether freeing a larger mapped
+ *                        chunk raises the threshold to its length
+ */
+void mm_set_mmap_threshold(size_t size, bool dynamic)
+{
+    __atomic_store_n(&mmap_threshold, size != 0 ? size : SIZE_MAX,
+                     __ATOMIC_RELAXED);
+    mmap_dynamic = dynamic;
+}
+
+/*
+ * mm_set_arenas: Sets the number of arenas threads are assigned to, 0 for one
+ *                per online CPU, and whether a thread uses the arena of the CPU
+ *                it runs on for each request instead of a fixed arena assigned
+ *                round-robin. Threads already assigned keep their arena.
+ */
+void mm_set_arenas(size_t count, bool by_cpu)
+{
+    if (count == 0)
     {
-        temp[1] = (word_t)temp_free;
-        temp[2] = 0;
-        temp_free[2] = (word_t)block;
-        free_back[index] = block;
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        count = ncpu > 0 ? (size_t)ncpu : 1;
     }
-
+    narenas = count < MAX_ARENAS ? count : MAX_ARENAS;
+    arena_by_cpu = by_cpu;
 }
 
 /*
- * remove_free_block: Removes the free block to appropriate free list. Blocks can
- *                    be removed anywhere from the free_list
+ * mm_stats: Fills st with the statistics of the allocator, taking the lock
+ *           of each arena in turn. Live bytes are those of the blocks, slab
+ *           objects and mapped chunks neither free in the heap nor parked
+ *           in a quick list, headers included, so they count the blocks held
+ *           by thread caches and those queued for their arena by other
+ *           threads.
  */
-void static remove_free_block(block_t* block)
+void mm_stats(struct mm_stats *st)
 {
-    // Finding the free_list to which to add the free block
-    size_t index = free_index(get_size(block));
+    size_t overhead = 0;
 
-    // Findind the next and previous free blocks
-    word_t* prev = (word_t*)(get_prev(block));
-    word_t* next = (word_t*)(get_next(block));
-    block_t* next_block = find_next(block);
-    
-    // Specifying the next block that the current block is allocated
-    set_prev_alloc(next_block,true);
-   
-    // Prev is null if the block being removed is the first bloxk in the list
-    if (prev == NULL)
+    _Static_assert(MM_STATS_BUCKETS == FL_COUNT,
+                   "MM_STATS_BUCKETS must match FL_COUNT");
+    memset(st, 0, sizeof(*st));
+
+    for (size_t i = 0; i < MAX_ARENAS; i++)
     {
-        // If the block is the first and only block in the list
-        if (free_listp[index] == free_back[index])
+        arena_t *a = &arenas[i];
+        arena_stats_t *as = &a->stats;
+
+        pthread_mutex_lock(&a->lock);
+        for (region_t *region = a->regions; region != NULL;
+             region = region->next)
+        {
+            st->heap_bytes += region->size;
+            overhead += sizeof(region_t) + dsize;
+        }
+        for (size_t fl = 0; fl < FL_COUNT; fl++)
+        {
+            st->bucket_bytes[fl] += as->free_bytes[fl];
+            st->bucket_blocks[fl] += as->free_blocks[fl];
+            st->free_bytes += as->free_bytes[fl];
+            st->free_blocks += as->free_blocks[fl];
+        }
+        // The largest free block is the last of the tree, or in the highest
+        // non-empty list
+        if (a->tree != NULL)
         {
-            free_listp[index] = (block_t*)next;
-            free_back[index] = (block_t*)next;
-            
-            if (next!=NULL)
+            block_t *block = a->tree;
+
+            while (*tree_child(block, true) != NULL)
             {
-                next[1] = 0;
+                block = *tree_child(block, true);
             }
-
+            st->largest_free = max(st->largest_free, get_size(block));
         }
-        
-        // If the block is the first, set the the prev pointer of the next block to NULL
-        else 
+        else if (a->fl_bitmap != 0)
         {
-            free_listp[index] = (block_t*)next;
-           
-            if (next!=NULL)
+            size_t fl = fls_index(a->fl_bitmap);
+            size_t sl = fls_index(a->sl_bitmap[fl]);
+
+            for (block_t *block = a->free_listp[fl][sl]; block != NULL;
+                 block = get_next(block))
             {
-                next[1] = 0;
+                st->largest_free = max(st->largest_free, get_size(block));
             }
-
         }
+        st->slab_bytes += as->slab_spans * SLAB_SPAN * SLAB_SIZE;
+        st->slab_used_bytes += as->slab_bytes;
+        st->slab_objects += as->slab_objects;
+        st->extend_calls += as->extend_calls;
+        for (size_t c = 0; c < 4; c++)
+        {
+            st->coalesce[c] += as->coalesce[c];
+        }
+        st->splits += as->splits;
+        st->quick_bytes += as->quick_bytes;
+        st->quick_blocks += as->quick_blocks;
+        pthread_mutex_unlock(&a->lock);
     }
 
+    st->mapped_chunks = __atomic_load_n(&mapped_chunks, __ATOMIC_RELAXED);
+    st->mapped_bytes = __atomic_load_n(&mapped_bytes, __ATOMIC_RELAXED);
+    st->live_bytes = st->heap_bytes - overhead - st->free_bytes -
+                     st->quick_bytes - st->slab_bytes + st->slab_used_bytes +
+                     st->mapped_bytes;
+}
 
-    // If the block is the last block in the list, set the next pointer of the previous 
-    // block to 0 and point the back pointer to the previous block
-    else if ((prev!=NULL) && (next == NULL))
+/*
+ * mm_stats_json: Writes the statistics of mm_stats to f as a JSON object on
+ *                one line. Bucket i of the free bytes and blocks holds the
+ *                blocks of 2^(i+7) up to 2^(i+8) bytes, bucket 0 those below
+ *                256 bytes.
+ */
+void mm_stats_json(FILE *f)
+{
+    struct mm_stats st;
+
+    mm_stats(&st);
+
+    fprintf(f, "{\"heap_bytes\":%zu,\"mapped_bytes\":%zu,"
+            "\"mapped_chunks\":%zu,\"live_bytes\":%zu,\"free_bytes\":%zu,"
+            "\"free_blocks\":%zu,\"quick_bytes\":%zu,\"quick_blocks\":%zu,"
+            "\"largest_free\":%zu,\"slab_bytes\":%zu,"
+            "\"slab_used_bytes\":%zu,\"slab_objects\":%zu,"
+            "\"extend_calls\":%zu,\"coalesce\":{\"none\":%zu,\"next\":%zu,"
+            "\"prev\":%zu,\"both\":%zu},\"splits\":%zu,\"bucket_bytes\":[",
+            st.heap_bytes, st.mapped_bytes, st.mapped_chunks, st.live_bytes,
+            st.free_bytes, st.free_blocks, st.quick_bytes, st.quick_blocks,
+            st.largest_free, st.slab_bytes,
+            st.slab_used_bytes, st.slab_objects, st.extend_calls,
+            st.coalesce[0], st.coalesce[1], st.coalesce[2], st.coalesce[3],
+            st.splits);
+    for (size_t i = 0; i < MM_STATS_BUCKETS; i++)
     {
-        
-        prev[2] = 0;
-        free_back[index] = (block_t*)prev;
-
+        fprintf(f, "%s%zu", i != 0 ? "," : "", st.bucket_bytes[i]);
     }
-    
-    // If the block is in the middle of the list, let previous block point to the next block
-    // and the next block's previous pointer point to the previous block
-    else if ((prev!=NULL) && (next != NULL))
+    fprintf(f, "],\"bucket_blocks\":[");
+    for (size_t i = 0; i < MM_STATS_BUCKETS; i++)
     {
-        
-        prev[2] = (word_t)next;
+        fprintf(f, "%s%zu", i != 0 ? "," : "", st.bucket_blocks[i]);
+    }
+    fprintf(f, "]}\n");
+}
+
+/*
+ * mm_profile_start: Starts sampling a request about every rate bytes, the
+ *                   default if rate is 0, for the heap profile. Returns
+ *                   false if the tables of the profile cannot be mapped.
+ */
+bool mm_profile_start(size_t rate)
+{
+    void *pcs[1];
+
+    rate = rate != 0 ? rate : PROFILE_RATE;
 
-        if (next!=NULL)
+    pthread_mutex_lock(&profile_lock);
+    if (profile_samples == NULL)
+    {
+        void *stacks = mmap(NULL, PROFILE_STACKS * sizeof(profile_stack_t),
+                            PROT_READ | PROT_WRITE, MAP_PRIVATE |
+                            MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        void *samples = mmap(NULL, PROFILE_SAMPLES * sizeof(profile_sample_t),
+                             PROT_READ | PROT_WRITE, MAP_PRIVATE |
+                             MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if (stacks == MAP_FAILED || samples == MAP_FAILED)
         {
-            next[1] = (word_t)prev;
+            if (stacks != MAP_FAILED)
+            {
+                munmap(stacks, PROFILE_STACKS * sizeof(profile_stack_t));
+            }
+            if (samples != MAP_FAILED)
+            {
+                munmap(samples, PROFILE_SAMPLES * sizeof(profile_sample_t));
+            }
+            pthread_mutex_unlock(&profile_lock);
+            return false;
         }
+        profile_stacks = stacks;
+        profile_samples = samples;
     }
+    profile_last_rate = rate;
+    pthread_mutex_unlock(&profile_lock);
 
-    return;
+    // The first backtrace loads the unwinder, which allocates
+    profile_busy = true;
+    backtrace(pcs, 1);
+    profile_busy = false;
+
+    __atomic_store_n(&profile_rate, rate, __ATOMIC_RELAXED);
+    return true;
 }
 
 /*
- * get_prev: Returns the previous free block from the current block
+ * mm_profile_stop: Stops sampling requests. Sampled blocks freed later are
+ *                  still dropped from the live samples.
  */
-static block_t * get_prev(block_t* block)
+void mm_profile_stop(void)
 {
-    word_t* addr = (word_t*)(block -> payload);
-    return (block_t*)(word_t*)addr[0];
-
+    __atomic_store_n(&profile_rate, 0, __ATOMIC_RELAXED);
 }
 
-
 /*
- * get_prev: Returns the next free block from the current block
+ * mm_profile_dump: Writes the heap profile to path in the heap_v2 text
+ *                  format of pprof: the live and total samples and bytes of
+ *                  each call stack, then the mappings of the process to
+ *                  symbolize it. Returns false on failure.
  */
-static block_t *get_next(block_t* block)
+bool mm_profile_dump(const char *path)
 {
-    word_t* addr = (word_t*)(block -> payload);
-    return (block_t*)(word_t*)addr[1];
-}
+    char buf[4096];
+    size_t len = 0;
+    size_t lc = 0, lb = 0, tc = 0, tb = 0;
+    bool busy = profile_busy;
+    bool ok;
+    ssize_t n;
+    int fd, maps;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // Nothing is sampled while the lock is held, as the writes may allocate
+    profile_busy = true;
+    pthread_mutex_lock(&profile_lock);
+    for (size_t i = 0; profile_stacks != NULL && i < PROFILE_STACKS; i++)
+    {
+        lc += profile_stacks[i].live_count;
+        lb += profile_stacks[i].live_bytes;
+        tc += profile_stacks[i].total_count;
+        tb += profile_stacks[i].total_bytes;
+    }
+    ok = profile_put(fd, buf, &len, "heap profile: %zu: %zu [%zu: %zu] "
+                     "@ heap_v2/%zu\n", lc, lb, tc, tb, profile_last_rate);
+    for (size_t i = 0; ok && profile_stacks != NULL && i < PROFILE_STACKS;
+         i++)
+    {
+        profile_stack_t *stack = &profile_stacks[i];
 
+        if (stack->hash == 0)
+        {
+            continue;
+        }
+        ok = profile_put(fd, buf, &len, "%zu: %zu [%zu: %zu] @",
+                         stack->live_count, stack->live_bytes,
+                         stack->total_count, stack->total_bytes);
+        for (uint32_t k = 0; ok && k < stack->depth; k++)
+        {
+            ok = profile_put(fd, buf, &len, " %p", stack->pcs[k]);
+        }
+        ok = ok && profile_put(fd, buf, &len, "\n");
+    }
+    pthread_mutex_unlock(&profile_lock);
 
-/*
- * write_header_new: Writes the header of the current block with the allocation status
- *                   of the previous block specified by alloc_prev
- */
-static void write_header_new(block_t *block, size_t size, bool alloc, bool alloc_prev)
+    ok = ok && profile_put(fd, buf, &len, "\nMAPPED_LIBRARIES:\n");
+    ok = ok && write(fd, buf, len) == (ssize_t)len;
+    maps = ok ? open("/proc/self/maps", O_RDONLY | O_CLOEXEC) : -1;
+    if (maps >= 0)
     {
-        bool prev_alloc = alloc_prev;
-        block->header = pack(size, alloc);
-        if (prev_alloc == true)
-            block->header |= 1 << 1;
-        if (prev_alloc == false)
-        block->header &= ~(1 << 1);
+        while ((n = read(maps, buf, sizeof(buf))) > 0 && ok)
+        {
+            ok = write(fd, buf, (size_t)n) == n;
+        }
+        close(maps);
     }
+    profile_busy = busy;
 
-/*
- * write_header_new: Writes the footer of the current block with the allocation status
- *                   of the previous block specified by alloc_prev
- */    
-static void write_footer_new(block_t *block, size_t size, bool alloc, bool alloc_prev)
-{
-   bool prev_alloc = alloc_prev;
-   word_t *footerp = (word_t *)((block->payload) + get_size(block) - dsize); 
-   *footerp = pack(size, alloc);
-   if (prev_alloc == true)
-        block->header |= 1 << 1;
-    if (prev_alloc == false)
-        block->header &= ~(1 << 1);
+    return close(fd) == 0 && ok;
+}
+
+/*
+ * mm_profile_signal: Makes the signal signo request a heap profile, written
+ *                    by the next sampled request to prefix followed by the
+ *                    pid, a number and .heap. Returns false on failure.
+ */
+bool mm_profile_signal(int signo, const char *prefix)
+{
+    struct sigaction sa;
+
+    if (strlen(prefix) >= sizeof(profile_prefix))
+    {
+        return false;
+    }
+    strcpy(profile_prefix, prefix);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = profile_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(signo, &sa, NULL) == 0;
+}
+
+/*
+ * realloc: returns a pointer to an allocated region of at least size bytes:
+ *          if ptrv is NULL, then call malloc(size);
+ *          if size == 0, then call free(ptr) and returns NULL;
+ *          else resizes the block in place if possible, see resize_block,
+ *          or remaps a mapped chunk that stays above mmap_threshold;
+ *          else allocates new region of memory, copies old data to new memory,
+ *          and then free old block. Returns NULL, leaving the old block
+ *          untouched, if realloc fails or returns new pointer on success.
+ */
+void *realloc(void *oldptr, size_t size) 
+{
+    size_t copysize;
+    void *newptr;
+
+    // If size == 0, then free block and return NULL
+    if (size == 0)
+    {
+        free(oldptr);
+        return NULL;
+    }
+
+    // If ptr is NULL, then equivalent to malloc
+    if (oldptr == NULL)
+    {
+        return malloc(size);
+    }
+
+    // A slab object is kept if the new size maps to the same slab class,
+    // a mapped chunk if it keeps the same length, and a block of the arena
+    // of the calling thread is shrunk or grown in place if possible. Blocks
+    // of other arenas move, so that only their owner edits its free lists.
+    if (pagemap_get(oldptr) & PM_SLAB)
+    {
+        if (size <= slab_limit && round_up(size, 16) == usable_size(oldptr))
+        {
+            return oldptr;
+        }
+    }
+    else if (get_sampled(payload_to_header(oldptr)))
+    {
+        // A sampled block moves, so that free drops it from the profile
+    }
+    else if (get_mapped(payload_to_header(oldptr)))
+    {
+        block_t *block = payload_to_header(oldptr);
+        if (size <= SIZE_MAX - MMAP_HUGE - *find_prev_footer(block) - wsize &&
+            mmap_length(size + *find_prev_footer(block) + wsize) ==
+            get_size(block))
+        {
+            return oldptr;
+        }
+        // The pages are moved by the kernel rather than copied
+        if (size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) &&
+            (newptr = mmap_resize(block, size)) != NULL)
+        {
+            return newptr;
+        }
+    }
+    else if (arena_of(oldptr) == arena_get() && size <= SIZE_MAX - dsize &&
+             resize_block(payload_to_header(oldptr), adjust_size(size)))
+    {
+        return oldptr;
+    }
+
+    // Otherwise, proceed with reallocation
+    newptr = malloc(size);
+    // If malloc fails, the original block is left untouched
+    if (!newptr)
+    {
+        return NULL;
+    }
+
+    // Copy the old data
+    copysize = usable_size(oldptr); // gets size of old payload
+    if(size < copysize)
+    {
+        copysize = size;
+    }
+    memcpy(newptr, oldptr, copysize);
+
+    // Free the old block
+    free(oldptr);
+
+    return newptr;
+}
+
+/*
+ * calloc: Allocates a block with size at least (elements * size + dsize)
+ *         through malloc, then initializes all bits in allocated memory to 0.
+ *         Returns NULL on failure.
+ */
+void *calloc (size_t nmemb, size_t size) {
+    void *bp;
+    block_t *block;
+    char *lo, *hi, *end;
+    size_t asize = nmemb * size;
+
+    if (nmemb != 0 && asize/nmemb != size)
+    // Multiplication overflowed
+    return NULL;
+
+    init_once();
+
+    // Blocks of the heap come with the part of them known to be zero
+    if (asize > slab_limit && asize <= SIZE_MAX - dsize &&
+        adjust_size(asize) > TCACHE_MAX_BLOCK &&
+        asize < __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) &&
+        __atomic_load_n(&profile_rate, __ATOMIC_RELAXED) == 0)
+    {
+        arena_t *a = arena_get();
+        pthread_mutex_lock(&a->lock);
+        remote_drain(a);
+        block = alloc_block_zero(a, adjust_size(asize), &lo, &hi);
+        pthread_mutex_unlock(&a->lock);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        bp = header_to_payload(block);
+    }
+    else
+    {
+        bp = malloc(asize);
+        if (bp == NULL)
+        {
+            return NULL;
+        }
+        // A mapped chunk is a new mapping
+        lo = hi = bp;
+        if (pagemap_get(bp) == 0 && get_mapped(payload_to_header(bp)))
+        {
+            hi = (char *)bp + asize;
+        }
+    }
+
+    // Initialize all bits to 0, outside of the part known to be zero
+    end = (char *)bp + asize;
+    if (hi > end)
+    {
+        hi = end;
+    }
+    if (lo >= hi)
+    {
+        lo = hi = end;
+    }
+    zero_range(bp, lo);
+    zero_range(hi, end);
+
+    return bp;
+}
+
+/********** START OF HELPER FUNCTIONS *********/
+
+/*
+ * init_heap: Body of mm_init, requires init_lock to be held. Resets every
+ *            arena and the page map, and creates the initial heap.
+ */
+static bool init_heap(void)
+{
+    for (size_t i = 0; i < MAX_ARENAS; i++)
+    {
+        arena_reset(&arenas[i]);
+        arenas[i].id = (uint8_t)i;
+    }
+
+    for (size_t i = 0; i < (1 << PM_L1_BITS); i++)
+    {
+        if (pagemap[i] != NULL)
+        {
+            memset(pagemap[i], 0, (size_t)1 << PM_L2_BITS);
+        }
+    }
+
+    if (narenas == 0)
+    {
+        mm_set_arenas(0, false);
+    }
+    pthread_once(&atfork_once, atfork_init);
+
+    // Blocks still held in thread caches belong to the old heap
+    heap_gen++;
+    heap_listp = NULL;
+    profile_reset();
+
+#ifdef COMPACT
+    // The first reservation is made by the first call to mem_sbrk
+    pthread_mutex_lock(&sbrk_lock);
+    mem_sbrk(0);
+    heap_base = mem_heap_lo();
+    pthread_mutex_unlock(&sbrk_lock);
+#endif
+
+    // Create the initial heap with a free block of chunksize bytes
+    if (extend_heap(&arenas[0], chunksize/dsize) == NULL)
+    {
+        return false;
+    }
+    heap_listp = region_first_block(arenas[0].regions);
+
+    // Once the heap serves requests, since sampling may allocate
+    pthread_once(&profile_once, profile_env_init);
+    pthread_once(&check_once, check_env_init);
+
+    return true;
+
+}
+
+/*
+ * init_once: Initializes the heap on the first request
+ */
+static void init_once(void)
+{
+    if (heap_listp == NULL) // Initialize heap if it isn't initialized
+    {
+        pthread_mutex_lock(&init_lock);
+        if (heap_listp == NULL)
+        {
+            init_heap();
+        }
+        pthread_mutex_unlock(&init_lock);
+    }
+}
+
+/*
+ * aligned_malloc: Allocates size bytes whose address is a multiple of align,
+ *                 a power of two, for the aligned entry points. Small requests
+ *                 rounded up to a multiple of align are slab objects, which are
+ *                 aligned as long as align divides the slab header. Large ones
+ *                 get a mapping of their own, with the payload placed at the
+ *                 first aligned address. Others are split off the front of an
+ *                 over-sized block by alloc_aligned_block, the leading slack
+ *                 going back to the free lists. Returns NULL on failure.
+ */
+static void *aligned_malloc(size_t align, size_t size)
+{
+    arena_t *a;
+    block_t *block;
+    void *bp;
+
+    if (align <= ALIGNMENT)
+    {
+        return malloc(size);
+    }
+
+    init_once();
+
+    if (size == 0)
+    {
+#ifdef DRIVER
+        return NULL;
+#else
+        size = 1;
+#endif
+    }
+    if (align > SIZE_MAX / 4 || size > SIZE_MAX / 2 - align)
+    {
+        return NULL;
+    }
+
+    // Objects of a slab class that is a multiple of align are aligned. While
+    // the heap is profiled, malloc may sample the request into a block only
+    // aligned to 16 bytes, so it takes an aligned block, unsampled like the
+    // other aligned requests.
+    if (align <= SLAB_HEADER && round_up(size, align) <= slab_limit &&
+        __atomic_load_n(&profile_rate, __ATOMIC_RELAXED) == 0)
+    {
+        return malloc(round_up(size, align));
+    }
+
+    if (size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+    {
+        bp = mmap_alloc(align, size);
+        if (bp != NULL)
+        {
+            return bp;
+        }
+    }
+
+    a = arena_get();
+    pthread_mutex_lock(&a->lock);
+    remote_drain(a);
+    block = alloc_aligned_block(a, align, adjust_size(size));
+    pthread_mutex_unlock(&a->lock);
+
+    return block != NULL ? header_to_payload(block) : NULL;
+}
+
+/*
+ * atfork_init: Installs the handlers that keep the locks of the allocator
+ *              consistent across fork
+ */
+static void atfork_init(void)
+{
+    pthread_atfork(atfork_prepare, atfork_release, atfork_release);
+}
+
+/*
+ * atfork_prepare: Takes every lock of the allocator, in lock order, before
+ *                 fork, so that the child does not inherit a lock held by a
+ *                 thread that does not exist in it
+ */
+static void atfork_prepare(void)
+{
+    pthread_mutex_lock(&init_lock);
+    for (size_t i = 0; i < MAX_ARENAS; i++)
+    {
+        pthread_mutex_lock(&arenas[i].lock);
+    }
+    pthread_mutex_lock(&sbrk_lock);
+    pthread_mutex_lock(&profile_lock);
+}
+
+/*
+ * atfork_release: Releases the locks taken by atfork_prepare, in the parent
+ *                 and in the child after fork
+ */
+static void atfork_release(void)
+{
+    pthread_mutex_unlock(&profile_lock);
+    pthread_mutex_unlock(&sbrk_lock);
+    for (size_t i = MAX_ARENAS; i-- > 0; )
+    {
+        pthread_mutex_unlock(&arenas[i].lock);
+    }
+    pthread_mutex_unlock(&init_lock);
+}
+
+/*
+ * adjust_size: Returns the block size serving a request of size bytes, which
+ *              includes the header and meets the alignment requirements
+ */
+static size_t adjust_size(size_t size)
+{
+    if (size <= min_block_size - wsize)
+        return min_block_size;
+    else 
+        return round_up(size+8,16); 
+}
+
+/*
+ * alloc_block: Allocates a block of asize bytes from the quick list of its
+ *              size, or else from the segregated free lists, coalescing the
+ *              quick lists if no fit is found, and then extending the heap by
+ *              max(asize, chunksize). Requires the lock of a to be held.
+ *              Returns NULL on failure.
+ */
+static block_t *alloc_block(arena_t *a, size_t asize)
+{
+    char *lo, *hi;
+
+    return alloc_block_zero(a, asize, &lo, &hi);
+}
+
+/*
+ * alloc_block_zero: Allocates a block of asize bytes like alloc_block, and
+ *                   stores in *lo and *hi the bounds of the part of its
+ *                   payload known to be zero, empty if there is none.
+ *                   Requires the lock of a to be held. Returns NULL on
+ *                   failure.
+ */
+static block_t *alloc_block_zero(arena_t *a, size_t asize, char **lo,
+                                 char **hi)
+{
+    size_t extendsize; //Amount to extend heap if no fit found
+    block_t *block;
+    char *zlo = NULL, *zhi = NULL;
+
+    // A parked block is still allocated, and has the exact size
+    block = quick_pop(a, asize);
+
+    if (block == NULL)
+    {
+        // Search the free list for a fit
+        block = find_fit(a, asize);
+        if (block == NULL && quick_flush(a))
+        {
+            block = find_fit(a, asize);
+        }
+
+        // purge_block released the whole pages past the list links
+        if (block != NULL && get_purged(block))
+        {
+            zlo = (char *)round_up((size_t)block + 4*wsize, PM_PAGE);
+            zhi = (char *)(((size_t)block + get_size(block) - wsize) /
+                           PM_PAGE * PM_PAGE);
+        }
+
+        if (block == NULL)
+        {
+            extendsize = max(asize, chunksize);
+            block = extend_heap(a, extendsize);
+            if (block == NULL) // extend_heap returns an error
+            {
+                return NULL;
+            }
+            // The new memory ends at the epilogue, and only its list links
+            // and footer were written since
+            if (SBRK_ZEROES)
+            {
+                zlo = (char *)a->epilogue + wsize -
+                      round_up(extendsize, dsize);
+                if (zlo < block->payload + 3*wsize)
+                {
+                    zlo = block->payload + 3*wsize;
+                }
+                zhi = (char *)a->epilogue - wsize;
+            }
+        }
+
+        place(a, block, asize);
+    }
+
+    // Only what lies in the allocated block counts
+    *lo = *hi = block->payload;
+    if (zlo != NULL)
+    {
+        *lo = zlo > block->payload ? zlo : block->payload;
+        *hi = zhi < (char *)find_next(block) ? zhi : (char *)find_next(block);
+        if (*lo >= *hi)
+        {
+            *lo = *hi = block->payload;
+        }
+    }
+
+    if (__atomic_load_n(&check_interval, __ATOMIC_RELAXED) != 0 &&
+        ++a->check_ticks >= check_interval)
+    {
+        check_step(a);
+    }
+    return block;
+}
+
+/*
+ * free_block: Drops the SAMPLED flag of the block, then parks it in the
+ *             quick list of its size, or else frees and coalesces it with
+ *             merge_block. Requires the lock of a to be held.
+ */
+static void free_block(arena_t *a, block_t *block)
+{
+    // The bit of SAMPLED reads as PURGED once the block is free
+    block->header &= ~(word_t)SAMPLED;
+
+    if (!quick_push(a, block))
+    {
+        merge_block(a, block);
+    }
+
+    // Every PURGE_TICKS frees, check whether blocks are due to be released
+    if (purge_decay_ms >= 0 && ++a->purge_ticks >= PURGE_TICKS)
+    {
+        arena_decay(a);
+    }
+
+    if (__atomic_load_n(&check_interval, __ATOMIC_RELAXED) != 0 &&
+        ++a->check_ticks >= check_interval)
+    {
+        check_step(a);
+    }
+}
+
+/*
+ * merge_block: Creates a new header footer for the free block, including the
+ *              allocation status of the previous block. Then set the
+ *              allocation bit of the next block to 0 and coalesces the block.
+ *              Requires the lock of a to be held.
+ */
+static void merge_block(arena_t *a, block_t *block)
+{
+    size_t size = get_size(block);
+
+    //Getting the alloc status of the previous block
+    bool prev_alloc = get_prev_alloc(block);
+    
+    //Making sure the new free block reflects the status of the previous block
+    write_header_new(block, size, false, prev_alloc);
+    write_footer_new(block, size, false, prev_alloc);
+
+    //Setting the next block prev alloc tag to false
+    block_t* next = find_next(block);
+    set_prev_alloc(next, false);
+    
+    coalesce(a, block);
+}
+
+/*
+ * alloc_aligned_block: Allocates a block of asize bytes from arena a whose
+ *                      payload address is a multiple of align, a power of two.
+ *                      Over-allocates by align + min_block_size so that the
+ *                      slack in front of the aligned payload can be split off
+ *                      and returned to the free lists. Requires the lock of a
+ *                      to be held. Returns NULL on failure.
+ */
+static block_t *alloc_aligned_block(arena_t *a, size_t align, size_t asize)
+{
+    size_t fitsize = asize + align + min_block_size;
+    size_t csize, lead;
+    uintptr_t payload, aligned;
+    bool prev_alloc;
+    block_t *block;
+
+    block = find_fit(a, fitsize);
+    if (block == NULL && quick_flush(a))
+    {
+        block = find_fit(a, fitsize);
+    }
+    if (block == NULL)
+    {
+        block = extend_heap(a, max(fitsize, chunksize));
+        if (block == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    // The slack in front of the aligned payload must fit a free block
+    payload = (uintptr_t)header_to_payload(block);
+    aligned = round_up(payload, align);
+    if (aligned != payload && aligned - payload < min_block_size)
+    {
+        aligned += align;
+    }
+
+    if (aligned != payload)
+    {
+        lead = aligned - payload;
+        csize = get_size(block);
+        prev_alloc = get_prev_alloc(block);
+        remove_free_block(a, block);
+
+        // The slack becomes a free block of its own
+        write_header_new(block, lead, false, prev_alloc);
+        write_footer_new(block, lead, false, prev_alloc);
+        block_t *next = find_next(block);
+        write_header_new(next, csize - lead, false, false);
+        write_footer_new(next, csize - lead, false, false);
+        add_free_block(a, block);
+        add_free_block(a, next);
+
+        block = next;
+    }
+
+    place(a, block, asize);
+    return block;
+}
+
+/*
+ * alloc_block_batch: Allocates n blocks of asize bytes from arena a, storing
+ *                    their payloads in ptrs. The blocks are carved one after
+ *                    the other out of a single block of n * asize bytes, taken
+ *                    from the free lists with a single removal, and allocated
+ *                    one by one only if there is no such block. Requires the
+ *                    lock of a to be held. Returns the number of blocks.
+ */
+static size_t alloc_block_batch(arena_t *a, size_t asize, size_t n, void **ptrs)
+{
+    size_t total, extra;
+    bool prev_alloc;
+    block_t *block = NULL;
+    size_t got;
+
+    if (n <= (SIZE_MAX / 2) / asize)
+    {
+        total = n * asize;
+        block = find_fit(a, total);
+        if (block == NULL && quick_flush(a))
+        {
+            block = find_fit(a, total);
+        }
+        if (block == NULL)
+        {
+            block = extend_heap(a, max(total, chunksize));
+        }
+    }
+
+    if (block == NULL)
+    {
+        for (got = 0; got < n; got++)
+        {
+            if ((block = alloc_block(a, asize)) == NULL)
+            {
+                break;
+            }
+            ptrs[got] = header_to_payload(block);
+        }
+        return got;
+    }
+
+    // The last block takes what place could not split off
+    place(a, block, total);
+    extra = get_size(block) - total;
+    prev_alloc = get_prev_alloc(block);
+    for (got = 0; got < n; got++)
+    {
+        write_header_new(block, asize + (got == n - 1 ? extra : 0), true,
+                         got == 0 ? prev_alloc : true);
+        ptrs[got] = header_to_payload(block);
+        block = find_next(block);
+    }
+
+    return n;
+}
+
+/*
+ * ptr_cmp: Orders pointers by address, for qsort
+ */
+static int ptr_cmp(const void *x, const void *y)
+{
+    uintptr_t a = (uintptr_t)*(void *const *)x;
+    uintptr_t b = (uintptr_t)*(void *const *)y;
+
+    return (a > b) - (a < b);
+}
+
+/*
+ * arena_alloc: Allocates a slab object if size is at most slab_limit, and a
+ *              block otherwise, from arena a. Requires the lock of a to be
+ *              held. Returns the payload, or NULL on failure.
+ */
+static void *arena_alloc(arena_t *a, size_t size)
+{
+    block_t *block;
+
+    if (size <= slab_limit)
+    {
+        return slab_alloc(a, (size - 1) / 16);
+    }
+
+    block = alloc_block(a, adjust_size(size));
+    return block != NULL ? header_to_payload(block) : NULL;
+}
+
+/*
+ * arena_free: Frees the slab object or block at ptr, owned by arena a.
+ *             Requires the lock of a to be held.
+ */
+static void arena_free(arena_t *a, void *ptr)
+{
+    if (pagemap_get(ptr) & PM_SLAB)
+    {
+        slab_free(a, ptr);
+    }
+    else
+    {
+        free_block(a, payload_to_header(ptr));
+    }
+}
+
+/*
+ * usable_size: Returns the number of bytes usable at ptr, the object size of
+ *              a slab object, the rest of the mapping for a mapped chunk, or
+ *              the payload size of a block
+ */
+static size_t usable_size(void *ptr)
+{
+    block_t *block = payload_to_header(ptr);
+
+    if (pagemap_get(ptr) & PM_SLAB)
+    {
+        return slab_of(ptr)->size;
+    }
+    if (get_mapped(block))
+    {
+        return get_size(block) - *find_prev_footer(block) - wsize;
+    }
+    return get_payload_size(block);
+}
+
+/*
+ * mmap_alloc: Maps a chunk with a payload of at least size bytes whose address
+ *             is a multiple of align, a power of two of at least ALIGNMENT,
+ *             rounded up to whole pages with its header. Returns the payload,
+ *             or NULL on failure.
+ */
+static void *mmap_alloc(size_t align, size_t size)
+{
+    size_t length;
+    char *base;
+    block_t *block;
+
+    if (size > SIZE_MAX - MMAP_HUGE - align)
+    {
+        return NULL;
+    }
+    length = mmap_length(size + align);
+
+    base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    // The payload is the first aligned address past the offset and header
+    block = payload_to_header((void *)round_up((size_t)base + dsize, align));
+    *find_prev_footer(block) = (word_t)((char *)block - base);
+    block->header = pack(length, true) | MAPPED;
+    __atomic_add_fetch(&mapped_chunks, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mapped_bytes, length, __ATOMIC_RELAXED);
+
+    return header_to_payload(block);
+}
+
+/*
+ * mmap_resize: Resizes the mapped chunk block with mremap so that its payload
+ *              holds at least size bytes, letting the kernel move the mapping
+ *              if it cannot grow in place. Returns the new payload, or NULL,
+ *              leaving the chunk untouched, on failure.
+ */
+static void *mmap_resize(block_t *block, size_t size)
+{
+    size_t offset = *find_prev_footer(block);
+    size_t old_length = get_size(block);
+    size_t length;
+    char *base;
+
+    if (size > SIZE_MAX - MMAP_HUGE - offset - wsize)
+    {
+        return NULL;
+    }
+    length = mmap_length(size + offset + wsize);
+
+    base = mremap((char *)block - offset, old_length, length, MREMAP_MAYMOVE);
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    // Wraps around to a subtraction when the chunk shrinks
+    __atomic_add_fetch(&mapped_bytes, length - old_length, __ATOMIC_RELAXED);
+    block = (block_t *)(base + offset);
+    block->header = pack(length, true) | MAPPED;
+
+    return header_to_payload(block);
+}
+
+/*
+ * mmap_length: Returns the length of the mapping holding a chunk of size
+ *              bytes, whole pages, or whole huge pages from MMAP_HUGE bytes
+ */
+static size_t mmap_length(size_t size)
+{
+    size_t length = round_up(size, PM_PAGE);
+
+    return length < MMAP_HUGE ? length : round_up(length, MMAP_HUGE);
+}
+
+/*
+ * mmap_free: Unmaps the mapped chunk block, and raises mmap_threshold to its
+ *            length if it is larger and the threshold is dynamic
+ */
+static void mmap_free(block_t *block)
+{
+    size_t length = get_size(block);
+
+    munmap((char *)block - *find_prev_footer(block), length);
+    __atomic_sub_fetch(&mapped_chunks, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&mapped_bytes, length, __ATOMIC_RELAXED);
+
+    if (mmap_dynamic && length <= MMAP_THRESHOLD_MAX &&
+        length > __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&mmap_threshold, length, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * extend_heap: Extends the heap of arena a with the requested number of bytes,
+ *              growing its newest region in place if it ends at the break, or
+ *              starting a new region otherwise, and recreates the epilogue
+ *              header. Returns a pointer to the result of coalescing the
+ *              newly-created block with previous free block, if applicable,
+ *              or NULL in failure.
+ */
+static block_t *extend_heap(arena_t *a, size_t size) 
+{
+    char *brk;
+    void *bp;
+    block_t *block;
+    bool prev_alloc;
+    bool in_place = false;
+    // Allocate an even number of words to maintain alignment
+    size = round_up(size, dsize);
+    a->stats.extend_calls++;
+
+    pthread_mutex_lock(&sbrk_lock);
+    brk = mem_sbrk(0);
+
+    if (a->epilogue != NULL && (char *)a->epilogue + wsize == brk)
+    {
+        if (!linkable(brk, brk + size) || !pagemap_reserve(brk, brk + size) ||
+            (bp = mem_sbrk(size)) == (void *)-1)
+        {
+            pthread_mutex_unlock(&sbrk_lock);
+            return NULL;
+        }
+
+        // The break moves to the start of a new reservation if the increment
+        // does not fit in the current one. Only the memlib of this repository
+        // does so, and it can lower the break again: the memory is given back
+        // and a new region starts there instead.
+        in_place = bp == brk;
+        if (!in_place)
+        {
+            mem_sbrk(-(intptr_t)size);
+            brk = bp;
+        }
+    }
+
+    if (in_place)
+    {
+        // The old epilogue header holds the allocation status of the last block
+        block = payload_to_header(bp);
+        prev_alloc = get_prev_alloc(block);
+        a->regions->size += size;
+    }
+    else
+    {
+        // A new region starts on a fresh page if the break is in a page owned
+        // by another arena
+        size_t pad = 0;
+        size_t rsize = sizeof(region_t) + size + dsize;
+        if (pagemap_get(brk - 1) != 0)
+        {
+            pad = round_up((size_t)brk, PM_PAGE) - (size_t)brk;
+        }
+
+        if (!linkable(brk, brk + pad + rsize) ||
+            !pagemap_reserve(brk, brk + pad + rsize) ||
+            (bp = mem_sbrk(pad + rsize)) == (void *)-1)
+        {
+            pthread_mutex_unlock(&sbrk_lock);
+            return NULL;
+        }
+
+        // A region that does not fit in the reservation starts the new one,
+        // on a page of its own, and its block takes the pad as well
+        if (bp != brk)
+        {
+            brk = bp;
+            rsize += pad;
+            size += pad;
+            pad = 0;
+            if (!linkable(brk, brk + rsize) ||
+                !pagemap_reserve(brk, brk + rsize))
+            {
+                mem_sbrk(-(intptr_t)rsize);
+                pthread_mutex_unlock(&sbrk_lock);
+                return NULL;
+            }
+        }
+
+        region_t *region = (region_t *)(brk + pad);
+        region->size = rsize;
+        region->next = a->regions;
+        a->regions = region;
+
+        word_t *start = (word_t *)(region + 1);
+        start[0] = pack(0, true); // Prologue footer
+        block = (block_t *)&start[1];
+        prev_alloc = true;
+        brk = (char *)region;
+    }
+
+    // Initialize free block header/footer 
+    write_header_new(block, size, false, prev_alloc);
+    write_footer_new(block, size, false, prev_alloc);
+
+    // Create new epilogue header
+    block_t *block_next = find_next(block);
+    write_header_new(block_next, 0, true, false);
+    a->epilogue = block_next;
+
+    pagemap_set(brk, (char *)block_next + wsize, a->id + 1);
+    pthread_mutex_unlock(&sbrk_lock);
+
+    // Coalesce in case the previous block was free
+    return coalesce(a, block);
+}
+
+
+/*
+ * linkable: Returns true if packed links reach the blocks of [lo, hi), which
+ *           is always the case outside of the compact layout. Requires
+ *           sbrk_lock to be held.
+ */
+static bool linkable(const char *lo, const char *hi)
+{
+#ifdef COMPACT
+    return lo >= heap_base && (size_t)(hi - heap_base) <= COMPACT_SPAN;
+#else
+    (void)lo;
+    (void)hi;
+    return true;
+#endif
+}
+
+
+/* Coalesce: Coalesces current block with previous and next blocks if
+ *           either or both are unallocated; otherwise the block is not
+ *           modified. Then, insert coalesced block into the segregated list.
+ *           Returns pointer to the coalesced block. After coalescing, the
+ *           immediate contiguous previous and next blocks must be allocated.
+ */
+static block_t *coalesce(arena_t *a, block_t * block) 
+{
+    
+    block_t *block_next = find_next(block);
+
+    // Find the allocation satus of the prev block
+    bool prev_alloc = get_prev_alloc(block);
+    bool next_alloc = get_alloc(block_next);
+
+    // If the previous block is not allocated, then the prev block has a footer
+    // and we can find the previous block
+    block_t *block_prev = NULL;
+    if (prev_alloc==false)
+        block_prev = find_prev(block);
+
+    size_t size = get_size(block);
+    
+    /* Case 1 - Next and previous blocks are allocated, just add the block 
+       to a free list */
+    if (prev_alloc && next_alloc)              
+    {
+        a->stats.coalesce[0]++;
+        
+        add_free_block(a, block);
+        return block;
+    }
+    /* Case 2 - Prev block is allocated, next block is free */
+    else if (prev_alloc && !next_alloc)       
+    {
+        a->stats.coalesce[1]++;
+        size += get_size(block_next);
+        remove_free_block(a, block_next);
+        write_header_new(block, size, false, true);
+        write_footer_new(block, size, false, true);
+        add_free_block(a, block);
+    }
+    /* Case 3 - Prev block is free and next block is allocated */
+    else if (!prev_alloc && next_alloc)        
+    {
+        a->stats.coalesce[2]++;
+        //getting alloc status of prev block of prev block 
+        bool prev_alloc_1 = get_prev_alloc(block_prev);
+
+        size += get_size(block_prev);
+        
+        remove_free_block(a, block_prev);
+    
+        write_header_new(block_prev, size, false, prev_alloc_1);
+        write_footer_new(block, size, false, prev_alloc_1);
+
+        block = block_prev;
+        add_free_block(a, block); 
+    }
+    
+    /* Case 4 - next and prev blocks are free */
+    else                                       
+    {
+        a->stats.coalesce[3]++;
+        //getting the alloc status of prev block of prev block
+        bool prev_alloc_1 = get_prev_alloc(block_prev);
+
+        size += get_size(block_next) + get_size(block_prev);
+
+        remove_free_block(a, block_prev);
+        remove_free_block(a, block_next);
+        write_header_new(block_prev, size, false, prev_alloc_1);
+        write_footer_new(block_next, size, false, prev_alloc_1);
+        
+        block = block_prev;
+        add_free_block(a, block);
+        
+    }
+    check_merged(a, block);
+    return block;
+}
+
+/*
+ * place: Places block with size of asize at the start of bp. If the remaining
+ *        size is at least the minimum block size, then split the block to the
+ *        the allocated block and the remaining block as free, which is then
+ *        inserted into the segregated list. Requires that the block is
+ *        initially unallocated.
+ */
+static void place(arena_t *a, block_t *block, size_t asize)
+{
+   
+
+    size_t csize = get_size(block);
+
+    if ((csize - asize) >= min_block_size)
+    {
+        //Get state of prev block
+        bool prev_alloc = get_prev_alloc(block);
+        
+        remove_free_block(a, block);
+
+        //Writing the header of the whole block as allocated, then splitting it
+        write_header_new(block, csize, true, prev_alloc);
+        split_block(a, block, asize);
+        a->stats.splits++;
+
+    }
+    /* Come here if exact size is found */
+    else
+    {
+        bool prev_alloc = get_prev_alloc(block);
+        write_header_new(block, csize, true, prev_alloc);
+        remove_free_block(a, block);
+    }
+
+    // The bit of PURGED would read as SAMPLED on the allocated block
+    dbg_ensures(!get_sampled(block));
+}
+
+/*
+ * split_block: Shrinks the allocated block to asize bytes and returns the
+ *              remaining part, which must be at least the minimum block size,
+ *              to the free lists, coalesced with the next block if it is free
+ */
+static void split_block(arena_t *a, block_t *block, size_t asize)
+{
+    size_t csize = get_size(block);
+    bool prev_alloc = get_prev_alloc(block);
+
+    //Writing only the header of the allocated block
+    write_header_new(block, asize, true, prev_alloc);
+
+    //Writing the header and footer of the new free block
+    block_t *rest = find_next(block);
+    write_header_new(rest, csize-asize, false, true);
+    write_footer_new(rest, csize-asize, false, true);
+
+    //Adding the remaining part of the block to the free list
+    coalesce(a, rest);
+}
+
+/*
+ * resize_block: Resizes the allocated block to asize bytes without moving it,
+ *               under the lock of the arena owning it, which must be that of
+ *               the calling thread. Shrinking returns the tail to the free
+ *               lists. Growing absorbs the next block if it is free and large
+ *               enough; when the block, or its free next block, is the last
+ *               one before the break, the heap is first extended by just the
+ *               missing amount. Returns false if the block cannot grow in
+ *               place.
+ */
+static bool resize_block(block_t *block, size_t asize)
+{
+    arena_t *a = arena_of(block);
+    size_t csize = get_size(block);
+    size_t have;
+    block_t *next;
+    bool ok = true;
+
+    pthread_mutex_lock(&a->lock);
+
+    if (asize > csize)
+    {
+        next = find_next(block);
+        if (next == a->epilogue ||
+            (!get_alloc(next) && find_next(next) == a->epilogue))
+        {
+            have = csize + (get_alloc(next) ? 0 : get_size(next));
+            // The new memory is a free block of its own until absorbed, so
+            // it must have room for the list links before the epilogue
+            if (have < asize && at_break(a))
+            {
+                extend_heap(a, max(asize - have, min_block_size));
+            }
+            next = find_next(block);
+        }
+
+        if (!get_alloc(next) && csize + get_size(next) >= asize)
+        {
+            remove_free_block(a, next);
+            csize += get_size(next);
+            write_header_new(block, csize, true, get_prev_alloc(block));
+            check_merged(a, block);
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+
+    if (ok && (csize - asize) >= min_block_size)
+    {
+        split_block(a, block, asize);
+    }
+
+    pthread_mutex_unlock(&a->lock);
+    return ok;
+}
+
+/*
+ * at_break: Returns true if the newest region of arena a ends at the break,
+ *           so that extend_heap grows it in place
+ */
+static bool at_break(arena_t *a)
+{
+    bool ok;
+
+    pthread_mutex_lock(&sbrk_lock);
+    ok = a->epilogue != NULL && (char *)a->epilogue + wsize == mem_sbrk(0);
+    pthread_mutex_unlock(&sbrk_lock);
+
+    return ok;
+}
+
+/*
+ * arena_trim: Lowers the break if the newest region of arena a ends at it and
+ *             its last block is free, giving back whole pages while keeping
+ *             at least pad bytes in that block. Where the break cannot be
+ *             lowered, releases the pages of the block instead. Requires the
+ *             lock of a to be held. Returns the number of bytes released.
+ */
+static size_t arena_trim(arena_t *a, size_t pad)
+{
+    block_t *block;
+    char *brk;
+    size_t size, release;
+
+    if (a->epilogue == NULL || get_prev_alloc(a->epilogue))
+    {
+        return 0;
+    }
+    block = find_prev(a->epilogue);
+    size = get_size(block);
+    if (pad > size || size - pad < min_block_size + PM_PAGE)
+    {
+        return 0;
+    }
+    release = (size - pad - min_block_size) / PM_PAGE * PM_PAGE;
+
+    pthread_mutex_lock(&sbrk_lock);
+    brk = mem_sbrk(0);
+    if (!SBRK_SHRINKS || (char *)a->epilogue + wsize != brk)
+    {
+        pthread_mutex_unlock(&sbrk_lock);
+        return get_purged(block) ? 0 : purge_block(block);
+    }
+
+    // The block leaves its list while the epilogue is still mapped
+    bool prev_alloc = get_prev_alloc(block);
+    remove_free_block(a, block);
+    if (mem_sbrk(-(intptr_t)release) == (void *)-1)
+    {
+        pthread_mutex_unlock(&sbrk_lock);
+        add_free_block(a, block);
+        return purge_block(block);
+    }
+
+    // The block shrinks, and the epilogue moves down to its new end
+    write_header_new(block, size - release, false, prev_alloc);
+    write_footer_new(block, size - release, false, prev_alloc);
+    a->epilogue = find_next(block);
+    write_header_new(a->epilogue, 0, true, false);
+    a->regions->size -= release;
+
+    // Pages past the new break no longer belong to the arena
+    brk -= release;
+    if (round_up((size_t)brk, PM_PAGE) < (size_t)brk + release)
+    {
+        pagemap_set((char *)round_up((size_t)brk, PM_PAGE), brk + release, 0);
+    }
+    pthread_mutex_unlock(&sbrk_lock);
+
+    add_free_block(a, block);
+    return release;
+}
+
+/*
+ * arena_purge: Releases the memory of the free blocks of arena a of at least
+ *              PURGE_MIN bytes not released yet, all of them if all is true,
+ *              otherwise those that became free before the current epoch.
+ *              Trims the end of the heap first. Requires the lock of a to be
+ *              held. Returns the number of bytes released.
+ */
+static size_t arena_purge(arena_t *a, bool all)
+{
+    size_t released = 0;
+    size_t fl, sl;
+    block_t *block;
+
+    if (a->epilogue != NULL && !get_prev_alloc(a->epilogue))
+    {
+        block = find_prev(a->epilogue);
+        if (get_size(block) >= PURGE_MIN && !get_purged(block) &&
+            (all || get_epoch(block) < a->purge_epoch))
+        {
+            released += arena_trim(a, all ? 0 : TRIM_PAD);
+        }
+    }
+
+    free_index(PURGE_MIN, &fl, &sl);
+    for (; fl < FL_COUNT; fl++, sl = 0)
+    {
+        if (!(a->fl_bitmap & ((uint64_t)1 << fl)))
+        {
+            continue;
+        }
+        for (; sl < SL_COUNT; sl++)
+        {
+            for (block = a->free_listp[fl][sl]; block != NULL;
+                 block = get_next(block))
+            {
+                if (get_size(block) >= PURGE_MIN && !get_purged(block) &&
+                    (all || get_epoch(block) < a->purge_epoch))
+                {
+                    released += purge_block(block);
+                }
+            }
+        }
+    }
+    released += tree_purge(a, a->tree, all);
+
+    return released;
+}
+
+/*
+ * arena_decay: Runs a purge pass over arena a if purge_decay_ms have passed
+ *              since the last one, and starts a new epoch. Requires the lock
+ *              of a to be held.
+ */
+static void arena_decay(arena_t *a)
+{
+    struct timespec ts;
+    uint64_t now;
+
+    a->purge_ticks = 0;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    now = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+    if (now - a->purge_time < (uint64_t)purge_decay_ms)
+    {
+        return;
+    }
+
+    arena_purge(a, false);
+    a->purge_time = now;
+    a->purge_epoch++;
+}
+
+/*
+ * purge_block: Releases the whole pages of the free block past its list links
+ *              and before its footer, and flags it PURGED. Returns the number
+ *              of bytes released.
+ */
+static size_t purge_block(block_t *block)
+{
+    size_t start = round_up((size_t)block + 4*wsize, PM_PAGE);
+    size_t end = ((size_t)block + get_size(block) - wsize) / PM_PAGE * PM_PAGE;
+
+    if (end <= start || madvise((void *)start, end - start, MADV_DONTNEED) != 0)
+    {
+        return 0;
+    }
+    block->header |= PURGED;
+
+    return end - start;
+}
+
+/*
+ * zero_range: Zeroes the bytes of [lo, hi). A range of at least CALLOC_REMAP
+ *             bytes has its whole pages released with MADV_DONTNEED instead,
+ *             so that they are replaced by zero pages when first touched.
+ */
+static void zero_range(char *lo, char *hi)
+{
+    char *start = (char *)round_up((size_t)lo, PM_PAGE);
+    char *end = (char *)((size_t)hi / PM_PAGE * PM_PAGE);
+
+    if (hi - lo >= CALLOC_REMAP && start < end &&
+        madvise(start, (size_t)(end - start), MADV_DONTNEED) == 0)
+    {
+        memset(lo, 0, (size_t)(start - lo));
+        memset(end, 0, (size_t)(hi - end));
+        return;
+    }
+    memset(lo, 0, (size_t)(hi - lo));
+}
+
+/*
+ * find_fit: Looks for a free block with at least asize bytes in bounded time.
+ *           The head of the list asize maps to is tried first; otherwise the
+ *           request is rounded up to the next sub-class, so that every block
+ *           of the first non-empty list at or above it fits, and that list
+ *           is found from the bitmaps. Requests of TREE_MIN bytes or more,
+ *           and those no list can serve, take the best fit of the tree.
+ *           Returns NULL if none is found.
+ */
+static block_t *find_fit(arena_t *a, size_t asize)
+{
+    size_t fl, sl;
+    uint32_t sl_map;
+    uint64_t fl_map;
+
+    if (asize >= TREE_MIN)
+    {
+        return tree_fit(a, asize);
+    }
+
+    // The first block of the list asize maps to may already be large enough,
+    // or another one the policy finds in that list
+    free_index(asize, &fl, &sl);
+    block_t *block = a->free_listp[fl][sl];
+    if (fit_search != MM_FIT_GOOD)
+    {
+        block = list_fit(a, block, asize);
+    }
+    if (block != NULL && asize <= get_size(block))
+    {
+        return block;
+    }
+
+    // Otherwise any block of a list at or above the rounded up index fits,
+    // and any block of the tree
+    if (!fit_index(asize, &fl, &sl))
+    {
+        return tree_fit(a, asize);
+    }
+
+    sl_map = a->sl_bitmap[fl] & (~(uint32_t)0 << sl);
+    if (sl_map == 0)
+    {
+        // No list left in this first level, take the next non-empty one
+        fl_map = a->fl_bitmap & (~(uint64_t)0 << (fl + 1));
+        if (fl_map == 0)
+        {
+            return tree_fit(a, asize);
+        }
+        fl = __builtin_ctzll(fl_map);
+        sl_map = a->sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+
+    // Every block of that list fits, best fit looks for the smallest
+    block = a->free_listp[fl][sl];
+    if (fit_search == MM_FIT_BEST)
+    {
+        block = list_fit(a, block, asize);
+    }
+    return block;
+}
+
+/*
+ * list_fit: Scans at most fit_scan blocks of the free list starting at head
+ *           for a block of at least asize bytes as fit_search says: the
+ *           first one, from the rover of arena a for next fit, or the
+ *           smallest one. Returns NULL if none of them fits.
+ */
+static block_t *list_fit(arena_t *a, block_t *head, size_t asize)
+{
+    block_t *block = head;
+    block_t *start, *fit = NULL;
+    size_t fl, sl, rfl, rsl;
+    bool wrapped = false;
+
+    // Next fit starts from the rover if it is in this list
+    if (fit_search == MM_FIT_NEXT && a->rover != NULL && head != NULL)
+    {
+        free_index(get_size(head), &fl, &sl);
+        free_index(get_size(a->rover), &rfl, &rsl);
+        if (rfl == fl && rsl == sl)
+        {
+            block = a->rover;
+        }
+    }
+
+    start = block;
+    for (size_t n = 0; block != NULL && n < fit_scan; n++)
+    {
+        size_t size = get_size(block);
+
+        if (size >= asize && (fit == NULL || size < get_size(fit)))
+        {
+            fit = block;
+            if (fit_search != MM_FIT_BEST || size == asize)
+            {
+                break;
+            }
+        }
+        block = get_next(block);
+        // Next fit wraps around to the head of the list, once
+        if (block == NULL && !wrapped)
+        {
+            block = start != head ? head : NULL;
+            wrapped = true;
+        }
+    }
+
+    // The rover moves past the block when it leaves the list
+    if (fit_search == MM_FIT_NEXT && fit != NULL)
+    {
+        a->rover = fit;
+    }
+    return fit;
+}
+
+/*
+ * add_free_block: Adds the free block to appropriate free list. Free block are added 
+ *                  to the back of each free list, or where fit_order puts
+ *                  them, or to the tree from TREE_MIN
+ */                  
+void static add_free_block(arena_t *a, block_t* block)
+{
+    // Finding the free_list to which to add the free block
+    size_t fl, sl;
+    free_index(get_size(block), &fl, &sl);
+    a->stats.free_bytes[fl] += get_size(block);
+    a->stats.free_blocks[fl]++;
+
+    block_t* back = a->free_back[fl][sl];
+    
+    // Specifying the next block that the current block is free
+    block_t* next = find_next(block);
+    set_prev_alloc(next,false);
+
+    // Large blocks remember when they became free
+    if (get_size(block) >= PURGE_MIN)
+    {
+        set_epoch(block, a->purge_epoch);
+    }
+
+    if (get_size(block) >= TREE_MIN)
+    {
+        tree_insert(a, block);
+        return;
+    }
+
+    /* The block is added to the back of the list by default, so it has no
+       next block and its prev pointer points to the old last block, which is
+       NULL when the list was empty. Otherwise it goes in front of the first
+       block, or of the first block at a higher address. */
+    block_t *front = NULL;
+    if (fit_order != MM_ORDER_FIFO)
+    {
+        back = NULL;
+        front = a->free_listp[fl][sl];
+        while (fit_order == MM_ORDER_ADDRESS && front != NULL && front < block)
+        {
+            back = front;
+            front = get_next(front);
+        }
+    }
+    set_prev(block, back);
+    set_next(block, front);
+
+    if (back == NULL)
+    {
+        a->free_listp[fl][sl] = block;
+        a->sl_bitmap[fl] |= (uint32_t)1 << sl;
+        a->fl_bitmap |= (uint64_t)1 << fl;
+    }
+    else
+    {
+        set_next(back, block);
+    }
+    if (front == NULL)
+    {
+        a->free_back[fl][sl] = block;
+    }
+    else
+    {
+        set_prev(front, block);
+    }
+
+}
+
+/*
+ * remove_free_block: Removes the free block to appropriate free list. Blocks can
+ *                    be removed anywhere from the free_list, or the tree
+ */
+void static remove_free_block(arena_t *a, block_t* block)
+{
+    // Finding the free_list from which to remove the free block
+    size_t fl, sl;
+    free_index(get_size(block), &fl, &sl);
+    a->stats.free_bytes[fl] -= get_size(block);
+    a->stats.free_blocks[fl]--;
+
+    // Findind the next and previous free blocks
+    block_t* prev = get_prev(block);
+    block_t* next = get_next(block);
+    block_t* next_block = find_next(block);
+    
+    // Specifying the next block that the current block is allocated
+    set_prev_alloc(next_block,true);
+
+    if (get_size(block) >= TREE_MIN)
+    {
+        tree_remove(a, block);
+        return;
+    }
+
+    // Next fit resumes from the block after the last one taken
+    if (a->rover == block)
+    {
+        a->rover = next;
+    }
+   
+    // Prev is null if the block being removed is the first block in the list
+    if (prev == NULL)
+    {
+        a->free_listp[fl][sl] = next;
+    }
+    else
+    {
+        set_next(prev, next);
+    }
+
+    // Next is null if the block being removed is the last block in the list
+    if (next == NULL)
+    {
+        a->free_back[fl][sl] = prev;
+    }
+    else
+    {
+        set_prev(next, prev);
+    }
+
+    // Clear the bitmaps once the list becomes empty
+    if (a->free_listp[fl][sl] == NULL)
+    {
+        a->sl_bitmap[fl] &= ~((uint32_t)1 << sl);
+        if (a->sl_bitmap[fl] == 0)
+        {
+            a->fl_bitmap &= ~((uint64_t)1 << fl);
+        }
+    }
+
+    return;
+}
+
+#ifdef COMPACT
+/*
+ * link_offset: Returns the packed form of a link to block, the offset of its
+ *              payload from heap_base in 16-byte units, or 0 for NULL
+ */
+static word_t link_offset(block_t *block)
+{
+    return block == NULL ? 0 : (word_t)(block->payload - heap_base) >> 4;
+}
+
+/*
+ * link_block: Returns the block a packed link of offset points to
+ */
+static block_t *link_block(word_t offset)
+{
+    return offset == 0 ? NULL : payload_to_header(heap_base + (offset << 4));
+}
+
+/*
+ * get_prev: Returns the previous free block from the current block
+ */
+static block_t *get_prev(block_t* block)
+{
+    word_t* addr = (word_t*)(block -> payload);
+    return link_block((uint32_t)addr[0] >> 1);
+}
+
+/*
+ * get_next: Returns the next free block from the current block
+ */
+static block_t *get_next(block_t* block)
+{
+    word_t* addr = (word_t*)(block -> payload);
+    return link_block(addr[0] >> 32);
+}
+
+/*
+ * set_prev: Sets the previous free block of the current block
+ */
+static void set_prev(block_t* block, block_t* prev)
+{
+    word_t* addr = (word_t*)(block -> payload);
+    addr[0] = (addr[0] & ~(word_t)UINT32_MAX) | link_offset(prev) << 1 |
+              LINK_TAG;
+}
+
+/*
+ * set_next: Sets the next free block of the current block
+ */
+static void set_next(block_t* block, block_t* next)
+{
+    word_t* addr = (word_t*)(block -> payload);
+    addr[0] = (addr[0] & UINT32_MAX) | link_offset(next) << 32 | LINK_TAG;
+}
+#else
+/*
+ * get_prev: Returns the previous free block from the current block
+ */
+static block_t * get_prev(block_t* block)
+{
+    word_t* addr = (word_t*)(block -> payload);
+    return (block_t*)(word_t*)addr[0];
+
+}
+
+
+/*
+ * get_prev: Returns the next free block from the current block
+ */
+static block_t *get_next(block_t* block)
+{
+    word_t* addr = (word_t*)(block -> payload);
+    return (block_t*)(word_t*)addr[1];
+}
+
+/*
+ * set_prev: Sets the previous free block of the current block
+ */
+static void set_prev(block_t* block, block_t* prev)
+{
+    word_t* addr = (word_t*)(block -> payload);
+    addr[0] = (word_t)prev;
+}
+
+/*
+ * set_next: Sets the next free block of the current block
+ */
+static void set_next(block_t* block, block_t* next)
+{
+    word_t* addr = (word_t*)(block -> payload);
+    addr[1] = (word_t)next;
+}
+#endif
+
+
+/*
+ * write_header_new: Writes the header of the current block with the allocation status
+ *                   of the previous block specified by alloc_prev
+ */
+static void write_header_new(block_t *block, size_t size, bool alloc, bool alloc_prev)
+    {
+        bool prev_alloc = alloc_prev;
+        block->header = pack(size, alloc);
+        if (prev_alloc == true)
+            block->header |= 1 << 1;
+        if (prev_alloc == false)
+        block->header &= ~(1 << 1);
+    }
+
+/*
+ * write_header_new: Writes the footer of the current block with the allocation status
+ *                   of the previous block specified by alloc_prev
+ */    
+static void write_footer_new(block_t *block, size_t size, bool alloc, bool alloc_prev)
+{
+   bool prev_alloc = alloc_prev;
+   word_t *footerp = (word_t *)((block->payload) + get_size(block) - dsize); 
+   *footerp = pack(size, alloc);
+   if (prev_alloc == true)
+        block->header |= 1 << 1;
+    if (prev_alloc == false)
+        block->header &= ~(1 << 1);
 }
 
 /*
  * set_prev_alloc: Set the allocation bit (2nd LSB) of the next block's header 
  *                 to alloc_prev
  */ 
-static void set_prev_alloc(block_t* block, bool alloc_prev)
+static void set_prev_alloc(block_t* block, bool alloc_prev)
+{
+    bool prev_alloc = alloc_prev;
+    if (prev_alloc == true)
+        block->header |= 1 << 1;
+    if (prev_alloc == false)
+        block->header &= ~(1 << 1);
+}
+
+/*
+ * get_mapped: Returns true if the block is a mapped chunk rather than a block
+ *             of the heap
+ */
+static bool get_mapped(block_t *block)
+{
+    return (block->header & MAPPED) != 0;
+}
+
+/*
+ * get_purged: Returns true if the pages of the free block have been released
+ */
+static bool get_purged(block_t *block)
+{
+    return (block->header & PURGED) != 0;
+}
+
+/*
+ * get_sampled: Returns true if the allocated block, or mapped chunk, was
+ *              sampled for the heap profile
+ */
+static bool get_sampled(block_t *block)
+{
+    return (block->header & SAMPLED) != 0;
+}
+
+/*
+ * get_epoch: Returns the purge epoch in which the free block, of at least
+ *            PURGE_MIN bytes, became free, kept after its list links
+ */
+static uint64_t get_epoch(block_t *block)
+{
+    return ((uint64_t *)block->payload)[2];
+}
+
+/*
+ * set_epoch: Sets the purge epoch in which the free block became free
+ */
+static void set_epoch(block_t *block, uint64_t epoch)
+{
+    ((uint64_t *)block->payload)[2] = epoch;
+}
+
+/*
+ * quick_push: Parks the allocated block in the quick list of its size in
+ *             arena a, and coalesces that list once it holds more than
+ *             quick_limit blocks. Requires the lock of a to be held. Returns
+ *             false if blocks of that size are not parked.
+ */
+static bool quick_push(arena_t *a, block_t *block)
+{
+    size_t size = get_size(block);
+    size_t bin = (size - min_block_size) / 16;
+
+    if (size > QUICK_MAX_BLOCK || quick_limit == 0)
+    {
+        return false;
+    }
+
+    write_header_new(block, size, true, get_prev_alloc(block));
+    *(block_t **)block->payload = a->quick[bin];
+    a->quick[bin] = block;
+    a->stats.quick_bytes += size;
+    a->stats.quick_blocks++;
+
+    if (++a->quick_count[bin] > quick_limit)
+    {
+        quick_flush_list(a, bin);
+    }
+    return true;
+}
+
+/*
+ * quick_pop: Takes a block of asize bytes from the quick list of arena a,
+ *            allocated already. Requires the lock of a to be held. Returns
+ *            NULL if that list is empty.
+ */
+static block_t *quick_pop(arena_t *a, size_t asize)
+{
+    size_t bin = (asize - min_block_size) / 16;
+    block_t *block;
+
+    if (asize > QUICK_MAX_BLOCK || (block = a->quick[bin]) == NULL)
+    {
+        return NULL;
+    }
+
+    a->quick[bin] = *(block_t **)block->payload;
+    a->quick_count[bin]--;
+    a->stats.quick_bytes -= asize;
+    a->stats.quick_blocks--;
+    return block;
+}
+
+/*
+ * quick_flush_list: Frees and coalesces every block of quick list bin of
+ *                   arena a. Requires the lock of a to be held.
+ */
+static void quick_flush_list(arena_t *a, size_t bin)
+{
+    block_t *block;
+
+    while ((block = quick_pop(a, bin * 16 + min_block_size)) != NULL)
+    {
+        merge_block(a, block);
+    }
+}
+
+/*
+ * quick_flush: Frees and coalesces the blocks of every quick list of arena
+ *              a. Requires the lock of a to be held. Returns false if there
+ *              were none.
+ */
+static bool quick_flush(arena_t *a)
+{
+    if (a->stats.quick_blocks == 0)
+    {
+        return false;
+    }
+    for (size_t bin = 0; bin < QUICK_BINS; bin++)
+    {
+        if (a->quick[bin] != NULL)
+        {
+            quick_flush_list(a, bin);
+        }
+    }
+    return true;
+}
+
+/*
+ * tree_child: Returns the link to the left, or right, child of the free
+ *             block in the tree, stored where list blocks keep their links
+ */
+static block_t **tree_child(block_t *block, bool right)
+{
+    return &((block_t **)block->payload)[right];
+}
+
+/*
+ * tree_priority: Returns the heap priority of the block in the tree, a hash
+ *                of its address, so that the tree has the shape of a random
+ *                binary search tree without storing priorities
+ */
+static uint64_t tree_priority(block_t *block)
+{
+    return ((uintptr_t)block >> 4) * 0x9e3779b97f4a7c15ull;
+}
+
+/*
+ * tree_less: Returns true if block x comes before block y in the tree, which
+ *            orders blocks by size, then by address
+ */
+static bool tree_less(block_t *x, block_t *y)
+{
+    size_t xsize = get_size(x), ysize = get_size(y);
+
+    return xsize < ysize || (xsize == ysize && x < y);
+}
+
+/*
+ * tree_insert: Inserts the free block into the tree of arena a: it replaces
+ *              the first node on its search path with a lower priority, and
+ *              the subtree of that node is split around it
+ */
+static void tree_insert(arena_t *a, block_t *block)
+{
+    uint64_t priority = tree_priority(block);
+    block_t **link = &a->tree;
+    block_t **left = tree_child(block, false);
+    block_t **right = tree_child(block, true);
+    block_t *node;
+
+    while (*link != NULL && tree_priority(*link) > priority)
+    {
+        link = tree_child(*link, tree_less(*link, block));
+    }
+
+    // Nodes before the block go to its left subtree, the others to its right
+    node = *link;
+    while (node != NULL)
+    {
+        if (tree_less(node, block))
+        {
+            *left = node;
+            left = tree_child(node, true);
+            node = *left;
+        }
+        else
+        {
+            *right = node;
+            right = tree_child(node, false);
+            node = *right;
+        }
+    }
+    *left = NULL;
+    *right = NULL;
+    *link = block;
+}
+
+/*
+ * tree_remove: Removes the free block, whose size must not have changed since
+ *              it was inserted, from the tree of arena a, replacing it with
+ *              the merge of its subtrees
+ */
+static void tree_remove(arena_t *a, block_t *block)
+{
+    block_t **link = &a->tree;
+    block_t *left = *tree_child(block, false);
+    block_t *right = *tree_child(block, true);
+
+    while (*link != block)
+    {
+        link = tree_child(*link, tree_less(*link, block));
+    }
+
+    // The root of the merge is the child with the higher priority
+    while (left != NULL && right != NULL)
+    {
+        if (tree_priority(left) > tree_priority(right))
+        {
+            *link = left;
+            link = tree_child(left, true);
+            left = *link;
+        }
+        else
+        {
+            *link = right;
+            link = tree_child(right, false);
+            right = *link;
+        }
+    }
+    *link = left != NULL ? left : right;
+}
+
+/*
+ * tree_fit: Returns the smallest free block of the tree of arena a with at
+ *           least asize bytes, the lowest one if several have that size, or
+ *           NULL if none is large enough
+ */
+static block_t *tree_fit(arena_t *a, size_t asize)
+{
+    block_t *node = a->tree;
+    block_t *fit = NULL;
+
+    while (node != NULL)
+    {
+        if (get_size(node) >= asize)
+        {
+            fit = node;
+            node = *tree_child(node, false);
+        }
+        else
+        {
+            node = *tree_child(node, true);
+        }
+    }
+    return fit;
+}
+
+/*
+ * tree_purge: Releases the memory of the free blocks of the subtree at node
+ *             not released yet, all of them if all is true, otherwise those
+ *             that became free before the current epoch of arena a. Returns
+ *             the number of bytes released.
+ */
+static size_t tree_purge(arena_t *a, block_t *node, bool all)
+{
+    size_t released = 0;
+
+    // Recurses on the left subtrees only, as deep as the tree
+    for (; node != NULL; node = *tree_child(node, true))
+    {
+        released += tree_purge(a, *tree_child(node, false), all);
+        if (!get_purged(node) && (all || get_epoch(node) < a->purge_epoch))
+        {
+            released += purge_block(node);
+        }
+    }
+    return released;
+}
+
+/*
+ * get_prev_alloc: Retrieve the allocation status of the previous block 
+ */ 
+static bool get_prev_alloc(block_t* block)
+{
+    return (block->header & 0x2);
+}
+
+/*
+ * fls_index: Returns the index of the most significant set bit of x
+ */
+static size_t fls_index(size_t x)
+{
+    return (sizeof(unsigned long long) * 8 - 1) - __builtin_clzll(x);
+}
+
+/*
+ * free_index: Finds the first level (fl) and second level (sl) index of the
+ *             free list containing blocks of size asize
+ */
+static void free_index(size_t asize, size_t *fl, size_t *sl)
+{
+    if (asize < SMALL_BLOCK)
+    {
+        *fl = 0;
+        *sl = asize >> 4;
+        return;
+    }
+
+    size_t log2 = fls_index(asize);
+    *fl = log2 - FL_SHIFT + 1;
+    *sl = (asize >> (log2 - SL_LOG2)) ^ SL_COUNT;
+}
+
+/*
+ * fit_index: Finds the index of the first free list whose blocks are all at
+ *            least asize bytes. Returns false if asize is too large to have one
+ */
+static bool fit_index(size_t asize, size_t *fl, size_t *sl)
+{
+    if (asize >= SMALL_BLOCK)
+    {
+        asize += ((size_t)1 << (fls_index(asize) - SL_LOG2)) - 1;
+    }
+    free_index(asize, fl, sl);
+
+    return *fl < FL_COUNT;
+}
+
+/*
+ * tcache_bin: Finds the thread cache bin serving requests of size bytes: the
+ *             bin of its slab class if size is at most slab_limit, or of its
+ *             block size otherwise. Returns false if such requests are not
+ *             cached.
+ */
+static bool tcache_bin(size_t size, size_t *bin)
+{
+    size_t asize;
+
+    if (size <= slab_limit)
+    {
+        *bin = (size - 1) / 16;
+    }
+    else
+    {
+        asize = adjust_size(size);
+        if (asize > TCACHE_MAX_BLOCK)
+        {
+            return false;
+        }
+        *bin = SLAB_CLASSES + (asize - min_block_size) / 16;
+    }
+    return tcache_capacity[*bin] != 0;
+}
+
+/*
+ * tcache_free_bin: Finds the thread cache bin a freed slab object or block
+ *                  at ptr belongs to. Returns false if it is not cached, in
+ *                  particular for blocks too small to serve any request
+ *                  larger than slab_limit.
+ */
+static bool tcache_free_bin(void *ptr, size_t *bin)
+{
+    size_t asize;
+
+    if (pagemap_get(ptr) & PM_SLAB)
+    {
+        *bin = slab_of(ptr)->size / 16 - 1;
+    }
+    else
+    {
+        asize = get_size(payload_to_header(ptr));
+        if (asize > TCACHE_MAX_BLOCK || asize - wsize <= slab_limit ||
+            get_sampled(payload_to_header(ptr)))
+        {
+            return false;
+        }
+        *bin = SLAB_CLASSES + (asize - min_block_size) / 16;
+    }
+    return tcache_capacity[*bin] != 0;
+}
+
+/*
+ * tcache_get: Returns the cache of the calling thread, emptied if the heap has
+ *             been reinitialized since it was last used, or NULL if the thread
+ *             is exiting. On first use, installs the destructor that drains
+ *             the cache when the thread exits.
+ */
+static tcache_t *tcache_get(void)
+{
+    tcache_t *tc = &tcache;
+
+    if (tc->disabled)
+    {
+        return NULL;
+    }
+
+    if (tc->gen != heap_gen)
+    {
+        for (size_t bin = 0; bin < TCACHE_BINS; bin++)
+        {
+            tc->bins[bin] = NULL;
+            tc->count[bin] = 0;
+        }
+        tc->gen = heap_gen;
+    }
+
+    if (!tc->registered)
+    {
+        pthread_once(&tcache_once, tcache_key_init);
+        pthread_setspecific(tcache_key, tc);
+        tc->registered = true;
+    }
+    return tc;
+}
+
+/*
+ * tcache_push: Pushes ptr onto the bin of the cache tc, flushing half of the
+ *              bin to the heap first if it is full
+ */
+static void tcache_push(tcache_t *tc, size_t bin, void *ptr)
+{
+    if (tc->count[bin] >= tcache_capacity[bin])
+    {
+        tcache_flush(tc, bin, tcache_capacity[bin] / 2);
+    }
+    *(void **)ptr = tc->bins[bin];
+    tc->bins[bin] = ptr;
+    tc->count[bin]++;
+}
+
+/*
+ * tcache_key_init: Creates the key whose destructor drains thread caches
+ */
+static void tcache_key_init(void)
+{
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/*
+ * tcache_destroy: Returns every block of an exiting thread's cache to the heap.
+ *                 Later requests of the thread bypass the cache.
+ */
+static void tcache_destroy(void *arg)
+{
+    tcache_t *tc = arg;
+
+    tc->disabled = true;
+    if (tc->gen != heap_gen)
+    {
+        return;
+    }
+    for (size_t bin = 0; bin < TCACHE_BINS; bin++)
+    {
+        if (tc->count[bin] != 0)
+        {
+            tcache_flush(tc, bin, 0);
+        }
+    }
+}
+
+/*
+ * tcache_refill: Allocates half the capacity of bin, at least one, slab objects
+ *                or blocks for bin under a single acquisition of the lock of
+ *                the thread's arena and adds them to the cache
+ */
+static void tcache_refill(tcache_t *tc, size_t bin)
+{
+    size_t count = max(tcache_capacity[bin] / 2, 1);
+    arena_t *a = arena_get();
+    block_t *block;
+    void *bp;
+
+    pthread_mutex_lock(&a->lock);
+    remote_drain(a);
+    while (count-- > 0)
+    {
+        if (bin < SLAB_CLASSES)
+        {
+            bp = slab_alloc(a, bin);
+        }
+        else
+        {
+            block = alloc_block(a, (bin - SLAB_CLASSES) * 16 + min_block_size);
+            bp = block != NULL ? header_to_payload(block) : NULL;
+        }
+        if (bp == NULL)
+        {
+            break;
+        }
+        *(void **)bp = tc->bins[bin];
+        tc->bins[bin] = bp;
+        tc->count[bin]++;
+    }
+    pthread_mutex_unlock(&a->lock);
+}
+
+/*
+ * tcache_flush: Frees cached payloads of bin until only keep of them are left.
+ *               Those of the thread's arena are freed under a single
+ *               acquisition of its lock, those of other arenas are queued on
+ *               their arena.
+ */
+static void tcache_flush(tcache_t *tc, size_t bin, size_t keep)
+{
+    arena_t *a = arena_get();
+    arena_t *owner;
+    void *bp;
+    bool locked = false;
+
+    while (tc->count[bin] > keep)
+    {
+        bp = tc->bins[bin];
+        tc->bins[bin] = *(void **)bp;
+        tc->count[bin]--;
+
+        owner = arena_of(bp);
+        if (owner != a)
+        {
+            remote_free(owner, bp);
+            continue;
+        }
+        if (!locked)
+        {
+            pthread_mutex_lock(&a->lock);
+            locked = true;
+        }
+        arena_free(a, bp);
+    }
+    if (locked)
+    {
+        pthread_mutex_unlock(&a->lock);
+    }
+}
+
+/*
+ * arena_get: Returns the arena serving requests of the calling thread, which
+ *            is either the arena of the current CPU or the arena assigned to
+ *            the thread round-robin on its first request
+ */
+static arena_t *arena_get(void)
+{
+    int cpu;
+
+    if (arena_by_cpu && (cpu = sched_getcpu()) >= 0)
+    {
+        return &arenas[(size_t)cpu % narenas];
+    }
+
+    if (thread_arena == NULL)
+    {
+        size_t index = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+        thread_arena = &arenas[index % narenas];
+    }
+    return thread_arena;
+}
+
+/*
+ * arena_of: Returns the arena owning the block or slab object at p, found
+ *           through the page map, which requires p to be in the heap
+ */
+static arena_t *arena_of(const void *p)
+{
+    size_t id = pagemap_get(p) & PM_ARENA;
+
+    // The pages of blocks and slabs hold the id + 1 of their arena, never 0
+    dbg_requires(id != 0);
+    return &arenas[id != 0 ? id - 1 : 0];
+}
+
+/*
+ * arena_reset: Empties the free lists of arena a and forgets its regions
+ */
+static void arena_reset(arena_t *a)
+{
+    for (size_t fl = 0; fl < FL_COUNT; fl++)
+    {
+        for (size_t sl = 0; sl < SL_COUNT; sl++)
+        {
+            a->free_listp[fl][sl] = NULL;
+            a->free_back[fl][sl] = NULL;
+        }
+        a->sl_bitmap[fl] = 0;
+    }
+    a->fl_bitmap = 0;
+    a->tree = NULL;
+    a->rover = NULL;
+    for (size_t bin = 0; bin < QUICK_BINS; bin++)
+    {
+        a->quick[bin] = NULL;
+        a->quick_count[bin] = 0;
+    }
+    a->regions = NULL;
+    a->epilogue = NULL;
+    a->remote_head = NULL;
+    a->remote_count = 0;
+    for (size_t cls = 0; cls < SLAB_CLASSES; cls++)
+    {
+        a->slab_partial[cls] = NULL;
+    }
+    a->slab_empty = NULL;
+    a->slab_nempty = 0;
+    a->purge_epoch = 0;
+    a->purge_time = 0;
+    a->purge_ticks = 0;
+    memset(&a->stats, 0, sizeof(a->stats));
+    a->check_ticks = 0;
+    a->check_region = NULL;
+    a->check_cursor = NULL;
+}
+
+/*
+ * remote_free: Pushes the block or slab object at ptr onto the remote free
+ *              queue of its arena a without taking the lock of a. Once the
+ *              queue holds REMOTE_THRESHOLD entries, drains it if the lock of
+ *              a is free.
+ */
+static void remote_free(arena_t *a, void *ptr)
+{
+    void *head = __atomic_load_n(&a->remote_head, __ATOMIC_RELAXED);
+
+    do
+    {
+        *(void **)ptr = head;
+    } while (!__atomic_compare_exchange_n(&a->remote_head, &head, ptr, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (__atomic_add_fetch(&a->remote_count, 1, __ATOMIC_RELAXED) >=
+            REMOTE_THRESHOLD &&
+        pthread_mutex_trylock(&a->lock) == 0)
+    {
+        remote_drain(a);
+        pthread_mutex_unlock(&a->lock);
+    }
+}
+
+/*
+ * remote_drain: Takes every entry of the remote free queue of a at once and
+ *               frees them. Requires the lock of a to be held.
+ */
+static void remote_drain(arena_t *a)
+{
+    void *bp;
+    void *next;
+
+    if (__atomic_load_n(&a->remote_head, __ATOMIC_RELAXED) == NULL)
+    {
+        return;
+    }
+
+    __atomic_store_n(&a->remote_count, 0, __ATOMIC_RELAXED);
+    bp = __atomic_exchange_n(&a->remote_head, NULL, __ATOMIC_ACQUIRE);
+    for (; bp != NULL; bp = next)
+    {
+        next = *(void **)bp;
+        arena_free(a, bp);
+    }
+}
+
+/*
+ * slab_alloc: Allocates an object of slab class cls, of (cls + 1) * 16 bytes,
+ *             from the first slab of the class with a free object, formatting
+ *             an empty slab if there is none. Requires the lock of a to be
+ *             held. Returns NULL on failure.
+ */
+static void *slab_alloc(arena_t *a, size_t cls)
+{
+    slab_t *slab = a->slab_partial[cls];
+    size_t word = 0;
+    size_t index;
+
+    if (slab == NULL)
+    {
+        slab = slab_new(a, (cls + 1) * 16);
+        if (slab == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    // Take the first free object, a full slab leaves the partial list
+    while (slab->freemap[word] == 0)
+    {
+        word++;
+    }
+    index = word * 64 + __builtin_ctzll(slab->freemap[word]);
+    slab->freemap[word] &= slab->freemap[word] - 1;
+    if (++slab->used == slab->count)
+    {
+        slab_unlink(&a->slab_partial[cls], slab);
+    }
+    a->stats.slab_objects++;
+    a->stats.slab_bytes += slab->size;
+
+    return (char *)slab + SLAB_HEADER + index * slab->size;
+}
+
+/*
+ * slab_alloc_batch: Allocates n objects of slab class cls into ptrs, taking
+ *                   all the free objects of a slab, a bitmap word at a time,
+ *                   before moving to the next. Requires the lock of a to be
+ *                   held. Returns the number of objects allocated.
+ */
+static size_t slab_alloc_batch(arena_t *a, size_t cls, size_t n, void **ptrs)
+{
+    slab_t *slab;
+    size_t got = 0;
+    size_t taken;
+    char *base;
+    uint64_t bits;
+
+    while (got < n)
+    {
+        slab = a->slab_partial[cls];
+        if (slab == NULL && (slab = slab_new(a, (cls + 1) * 16)) == NULL)
+        {
+            break;
+        }
+
+        base = (char *)slab + SLAB_HEADER;
+        taken = got;
+        for (size_t word = 0; word < SLAB_MAP_WORDS && got < n; word++)
+        {
+            bits = slab->freemap[word];
+            while (bits != 0 && got < n)
+            {
+                ptrs[got++] = base + (word * 64 + __builtin_ctzll(bits)) *
+                                         slab->size;
+                bits &= bits - 1;
+            }
+            slab->freemap[word] = bits;
+        }
+
+        slab->used += (uint16_t)(got - taken);
+        a->stats.slab_objects += got - taken;
+        a->stats.slab_bytes += (got - taken) * slab->size;
+        if (slab->used == slab->count)
+        {
+            slab_unlink(&a->slab_partial[cls], slab);
+        }
+    }
+
+    return got;
+}
+
+/*
+ * slab_free: Frees the slab object at ptr. A slab that was full rejoins the
+ *            partial list of its class, and a slab left empty is released.
+ *            Requires the lock of a to be held.
+ */
+static void slab_free(arena_t *a, void *ptr)
 {
-    bool prev_alloc = alloc_prev;
-    if (prev_alloc == true)
-        block->header |= 1 << 1;
-    if (prev_alloc == false)
-        block->header &= ~(1 << 1);
+    slab_t *slab = slab_of(ptr);
+    size_t cls = slab->size / 16 - 1;
+    size_t index = (size_t)((char *)ptr - ((char *)slab + SLAB_HEADER)) /
+                   slab->size;
+
+    slab->freemap[index / 64] |= (uint64_t)1 << (index % 64);
+    a->stats.slab_objects--;
+    a->stats.slab_bytes -= slab->size;
+    if (slab->used-- == slab->count)
+    {
+        slab_push(&a->slab_partial[cls], slab);
+    }
+    if (slab->used == 0)
+    {
+        slab_unlink(&a->slab_partial[cls], slab);
+        slab_release(a, slab);
+    }
+}
+
+/*
+ * slab_new: Takes an empty slab, carving a new span if there is none, formats
+ *           it for objects of size bytes and adds it to the partial list of
+ *           its class. Requires the lock of a to be held. Returns NULL on
+ *           failure.
+ */
+static slab_t *slab_new(arena_t *a, size_t size)
+{
+    slab_t *slab;
+    size_t index;
+    size_t avail;
+
+    if (a->slab_empty == NULL && !slab_span(a))
+    {
+        return NULL;
+    }
+
+    slab = a->slab_empty;
+    slab_unlink(&a->slab_empty, slab);
+    a->slab_nempty--;
+    slab->span->live++;
+
+    // The last slab of a span ends with the header of the next block
+    avail = SLAB_SIZE - SLAB_HEADER;
+    if ((char *)slab == (char *)slab->span + (SLAB_SPAN - 1) * SLAB_SIZE)
+    {
+        avail -= wsize;
+    }
+
+    slab->size = (uint16_t)size;
+    slab->used = 0;
+    slab->count = (uint16_t)(avail / size);
+    for (index = 0; index < SLAB_MAP_WORDS; index++)
+    {
+        slab->freemap[index] = 0;
+    }
+    for (index = 0; index < slab->count; index++)
+    {
+        slab->freemap[index / 64] |= (uint64_t)1 << (index % 64);
+    }
+
+    slab_push(&a->slab_partial[size / 16 - 1], slab);
+    return slab;
+}
+
+/*
+ * slab_span: Allocates a page-aligned block of SLAB_SPAN slabs from arena a,
+ *            flags its pages as slab pages in the page map, and adds its
+ *            slabs to the empty list. Requires the lock of a to be held.
+ *            Returns false on failure.
+ */
+static bool slab_span(arena_t *a)
+{
+    block_t *block = alloc_aligned_block(a, SLAB_SIZE, SLAB_SPAN * SLAB_SIZE);
+    slab_t *span;
+    slab_t *slab;
+
+    if (block == NULL)
+    {
+        return false;
+    }
+
+    span = header_to_payload(block);
+    pthread_mutex_lock(&sbrk_lock);
+    pagemap_set(span, (char *)span + SLAB_SPAN * SLAB_SIZE,
+                (uint8_t)((a->id + 1) | PM_SLAB));
+    pthread_mutex_unlock(&sbrk_lock);
+
+    for (size_t i = 0; i < SLAB_SPAN; i++)
+    {
+        slab = (slab_t *)((char *)span + i * SLAB_SIZE);
+        slab->span = span;
+        slab->size = 0;
+        slab_push(&a->slab_empty, slab);
+    }
+    span->live = 0;
+    a->slab_nempty += SLAB_SPAN;
+    a->stats.slab_spans++;
+
+    return true;
+}
+
+/*
+ * slab_release: Adds the slab, left empty, to the empty list. When no slab of
+ *               its span is in use anymore and the arena keeps another span
+ *               worth of empty slabs, the span is returned to the heap.
+ *               Requires the lock of a to be held.
+ */
+static void slab_release(arena_t *a, slab_t *slab)
+{
+    slab_t *span = slab->span;
+
+    slab->size = 0;
+    slab_push(&a->slab_empty, slab);
+    a->slab_nempty++;
+
+    if (--span->live != 0 || a->slab_nempty < 2 * SLAB_SPAN)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < SLAB_SPAN; i++)
+    {
+        slab_unlink(&a->slab_empty, (slab_t *)((char *)span + i * SLAB_SIZE));
+    }
+    a->slab_nempty -= SLAB_SPAN;
+    a->stats.slab_spans--;
+
+    pthread_mutex_lock(&sbrk_lock);
+    pagemap_set(span, (char *)span + SLAB_SPAN * SLAB_SIZE,
+                (uint8_t)(a->id + 1));
+    pthread_mutex_unlock(&sbrk_lock);
+    free_block(a, payload_to_header(span));
+}
+
+/*
+ * slab_push: Adds slab to the front of the partial or empty list
+ */
+static void slab_push(slab_t **list, slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL)
+    {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+/*
+ * slab_unlink: Removes slab from the partial or empty list
+ */
+static void slab_unlink(slab_t **list, slab_t *slab)
+{
+    if (slab->prev != NULL)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        *list = slab->next;
+    }
+    if (slab->next != NULL)
+    {
+        slab->next->prev = slab->prev;
+    }
+}
+
+/*
+ * slab_of: Returns the slab holding the slab object at ptr
+ */
+static slab_t *slab_of(void *ptr)
+{
+    return (slab_t *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+/*
+ * region_first_block: Returns the first block of region, which follows the
+ *                     region header and the prologue footer
+ */
+static block_t *region_first_block(region_t *region)
+{
+    return (block_t *)((char *)(region + 1) + wsize);
+}
+
+/*
+ * pagemap_get: Returns the page map entry of the page containing p
+ */
+static uint8_t pagemap_get(const void *p)
+{
+    uintptr_t page = (uintptr_t)p >> PM_PAGE_SHIFT;
+    uint8_t *l2;
+
+    if ((page >> PM_L2_BITS) >= ((uintptr_t)1 << PM_L1_BITS))
+    {
+        return 0;
+    }
+    l2 = __atomic_load_n(&pagemap[page >> PM_L2_BITS], __ATOMIC_ACQUIRE);
+    if (l2 == NULL)
+    {
+        return 0;
+    }
+    return l2[page & (((uintptr_t)1 << PM_L2_BITS) - 1)];
+}
+
+/*
+ * pagemap_reserve: Maps the second level tables covering [start, end).
+ *                  Requires sbrk_lock to be held. Returns false on failure.
+ */
+static bool pagemap_reserve(const void *start, const void *end)
+{
+    uintptr_t first = ((uintptr_t)start >> PM_PAGE_SHIFT) >> PM_L2_BITS;
+    uintptr_t last = (((uintptr_t)end - 1) >> PM_PAGE_SHIFT) >> PM_L2_BITS;
+    uint8_t *l2;
+
+    if (last >= ((uintptr_t)1 << PM_L1_BITS))
+    {
+        return false;
+    }
+    for (uintptr_t i = first; i <= last; i++)
+    {
+        if (pagemap[i] != NULL)
+        {
+            continue;
+        }
+        l2 = mmap(NULL, (size_t)1 << PM_L2_BITS, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (l2 == MAP_FAILED)
+        {
+            return false;
+        }
+        __atomic_store_n(&pagemap[i], l2, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+/*
+ * pagemap_set: Sets the entry of every page overlapping [start, end) to val.
+ *              Requires sbrk_lock to be held and the range to be reserved.
+ */
+static void pagemap_set(const void *start, const void *end, uint8_t val)
+{
+    uintptr_t page = (uintptr_t)start >> PM_PAGE_SHIFT;
+    uintptr_t last = ((uintptr_t)end - 1) >> PM_PAGE_SHIFT;
+    uintptr_t mask = ((uintptr_t)1 << PM_L2_BITS) - 1;
+
+    for (; page <= last; page++)
+    {
+        pagemap[page >> PM_L2_BITS][page & mask] = val;
+    }
+}
+
+/*
+ * profile_tick: Counts size bytes against the interval of the calling thread
+ *               and returns true if the request is to be sampled, drawing
+ *               the next interval
+ */
+static bool profile_tick(size_t size)
+{
+    if (profile_busy)
+    {
+        return false;
+    }
+    if (size < profile_left)
+    {
+        profile_left -= size;
+        return false;
+    }
+    profile_left = profile_interval(__atomic_load_n(&profile_rate,
+                                                    __ATOMIC_RELAXED));
+    return true;
+}
+
+/*
+ * profile_interval: Returns a number of bytes drawn from an exponential
+ *                   distribution of mean rate, as -ln(u) * rate for u
+ *                   uniform in (0, 1), with the logarithm approximated
+ */
+static size_t profile_interval(size_t rate)
+{
+    uint64_t r;
+    size_t e;
+    double m;
+    double log2u;
+
+    if (profile_seed == 0)
+    {
+        profile_seed = ((uint64_t)(uintptr_t)&profile_seed ^
+                        (uint64_t)time(NULL)) * 0x9e3779b97f4a7c15ull | 1;
+    }
+    profile_seed ^= profile_seed << 13;
+    profile_seed ^= profile_seed >> 7;
+    profile_seed ^= profile_seed << 17;
+
+    // u = r / 2^53 = 2^(e - 53) * m, with m in [1, 2), and log2(m) taken
+    // from the parabola through it at m = 1, 1.5 and 2
+    r = (profile_seed >> 11) | 1;
+    e = fls_index(r);
+    m = (double)r / (double)((uint64_t)1 << e);
+    log2u = (double)e - 53 + (m - 1) * (1.33985 - 0.33985 * (m - 1));
+
+    return (size_t)(-log2u * 0.693147 * (double)rate) + 1;
+}
+
+/*
+ * profile_alloc: Allocates size bytes for a sampled request as a block of
+ *                its own, or a mapped chunk from mmap_threshold, with the
+ *                SAMPLED flag, and records it with its call stack. Writes
+ *                the profile requested by a signal first. Returns NULL, for
+ *                malloc to serve the request as usual, if the tables of the
+ *                profile are full or memory runs out.
+ */
+static void *profile_alloc(size_t size)
+{
+    void *pcs[PROFILE_DEPTH + 2];
+    profile_sample_t *sample;
+    profile_stack_t *stack;
+    block_t *block;
+    arena_t *a;
+    void *bp = NULL;
+    uint32_t index;
+    int depth;
+    bool ok;
+
+    profile_busy = true;
+    if (__atomic_exchange_n(&profile_pending, 0, __ATOMIC_RELAXED))
+    {
+        profile_dump_next();
+    }
+
+    // The first two return addresses are in profile_alloc and malloc
+    depth = backtrace(pcs, PROFILE_DEPTH + 2) - 2;
+    depth = depth > 0 ? depth : 0;
+
+    // A slot is reserved for the sample before its block is allocated
+    pthread_mutex_lock(&profile_lock);
+    ok = profile_samples != NULL && profile_nsamples < PROFILE_SAMPLES / 2 &&
+         profile_stack_index(pcs + 2, depth, &index);
+    if (ok)
+    {
+        profile_nsamples++;
+    }
+    pthread_mutex_unlock(&profile_lock);
+    if (!ok)
+    {
+        profile_busy = false;
+        return NULL;
+    }
+
+    if (size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) &&
+        (bp = mmap_alloc(ALIGNMENT, size)) != NULL)
+    {
+        payload_to_header(bp)->header |= SAMPLED;
+    }
+    else
+    {
+        // The header is written under the lock, as neighbours update it
+        a = arena_get();
+        pthread_mutex_lock(&a->lock);
+        remote_drain(a);
+        if ((block = alloc_block(a, adjust_size(size))) != NULL)
+        {
+            block->header |= SAMPLED;
+            bp = header_to_payload(block);
+        }
+        pthread_mutex_unlock(&a->lock);
+    }
+
+    pthread_mutex_lock(&profile_lock);
+    if (bp == NULL)
+    {
+        profile_nsamples--;
+    }
+    else
+    {
+        sample = &profile_samples[profile_find(bp)];
+        sample->ptr = bp;
+        sample->size = size;
+        sample->stack = index;
+        stack = &profile_stacks[index];
+        stack->live_count++;
+        stack->live_bytes += size;
+        stack->total_count++;
+        stack->total_bytes += size;
+    }
+    pthread_mutex_unlock(&profile_lock);
+
+    profile_busy = false;
+    return bp;
+}
+
+/*
+ * profile_free: Drops the sampled block at ptr from the live samples,
+ *               shifting back the samples after it in its probe sequence
+ */
+static void profile_free(void *ptr)
+{
+    profile_sample_t *samples = profile_samples;
+    profile_stack_t *stack;
+    size_t mask = PROFILE_SAMPLES - 1;
+    size_t i, j, home;
+
+    pthread_mutex_lock(&profile_lock);
+    i = profile_find(ptr);
+    if (samples[i].ptr != ptr)
+    {
+        pthread_mutex_unlock(&profile_lock);
+        return;
+    }
+    stack = &profile_stacks[samples[i].stack];
+    stack->live_count--;
+    stack->live_bytes -= samples[i].size;
+    profile_nsamples--;
+
+    for (j = (i + 1) & mask; samples[j].ptr != NULL; j = (j + 1) & mask)
+    {
+        // A sample stays if its home slot lies after the hole, up to j
+        home = profile_home(samples[j].ptr);
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+        {
+            continue;
+        }
+        samples[i] = samples[j];
+        i = j;
+    }
+    samples[i].ptr = NULL;
+    pthread_mutex_unlock(&profile_lock);
+}
+
+/*
+ * profile_stack_index: Finds the call stack of depth return addresses at
+ *                      pcs in the stack table, adding it if it is new, and
+ *                      stores its index. Requires profile_lock to be held.
+ *                      Returns false if the table is full.
+ */
+static bool profile_stack_index(void **pcs, int depth, uint32_t *index)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    profile_stack_t *stack;
+    size_t i;
+    int k;
+
+    for (k = 0; k < depth; k++)
+    {
+        hash = (hash ^ (uint64_t)(uintptr_t)pcs[k]) * 0x100000001b3ull;
+    }
+    hash |= 1;
+
+    for (i = hash & (PROFILE_STACKS - 1); ; i = (i + 1) & (PROFILE_STACKS - 1))
+    {
+        stack = &profile_stacks[i];
+        if (stack->hash == 0)
+        {
+            break;
+        }
+        if (stack->hash != hash || stack->depth != (uint32_t)depth)
+        {
+            continue;
+        }
+        for (k = 0; k < depth && stack->pcs[k] == pcs[k]; k++)
+            ;
+        if (k == depth)
+        {
+            *index = (uint32_t)i;
+            return true;
+        }
+    }
+
+    if (profile_nstacks >= PROFILE_STACKS / 4 * 3)
+    {
+        return false;
+    }
+    profile_nstacks++;
+    stack->hash = hash;
+    stack->depth = (uint32_t)depth;
+    for (k = 0; k < depth; k++)
+    {
+        stack->pcs[k] = pcs[k];
+    }
+    *index = (uint32_t)i;
+    return true;
+}
+
+/*
+ * profile_home: Returns the slot of the sample table at which the probe
+ *               sequence for ptr starts
+ */
+static size_t profile_home(const void *ptr)
+{
+    return (((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15ull) >>
+           (64 - PROFILE_SAMPLE_BITS);
+}
+
+/*
+ * profile_find: Returns the slot of the sample table holding ptr, or the
+ *               empty slot ending its probe sequence. Requires profile_lock
+ *               to be held.
+ */
+static size_t profile_find(const void *ptr)
+{
+    size_t i = profile_home(ptr);
+
+    while (profile_samples[i].ptr != NULL && profile_samples[i].ptr != ptr)
+    {
+        i = (i + 1) & (PROFILE_SAMPLES - 1);
+    }
+    return i;
+}
+
+/*
+ * profile_reset: Drops the live samples, whose blocks belong to a heap that
+ *                is being reset, keeping the totals of each call stack
+ */
+static void profile_reset(void)
+{
+    pthread_mutex_lock(&profile_lock);
+    if (profile_samples != NULL)
+    {
+        for (size_t i = 0; i < PROFILE_SAMPLES; i++)
+        {
+            profile_samples[i].ptr = NULL;
+        }
+        for (size_t i = 0; i < PROFILE_STACKS; i++)
+        {
+            profile_stacks[i].live_count = 0;
+            profile_stacks[i].live_bytes = 0;
+        }
+        profile_nsamples = 0;
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+
+/*
+ * profile_env_init: Starts sampling if MM_PROFILE holds a rate, 0 for the
+ *                   default, and writes a profile to MM_PROFILE_PREFIX, or
+ *                   mm, followed by the pid, a number and .heap, on SIGUSR2
+ */
+static void profile_env_init(void)
+{
+    const char *rate = getenv("MM_PROFILE");
+    const char *prefix = getenv("MM_PROFILE_PREFIX");
+
+    if (rate != NULL && mm_profile_start(strtoul(rate, NULL, 0)))
+    {
+        mm_profile_signal(SIGUSR2, prefix != NULL ? prefix : "mm");
+    }
+}
+
+/*
+ * profile_signal_handler: Asks the next sampled request to write a profile,
+ *                         as the tables cannot be read from a signal
+ */
+static void profile_signal_handler(int signo)
+{
+    (void)signo;
+    profile_pending = 1;
 }
 
 /*
- * get_prev_alloc: Retrieve the allocation status of the previous block 
- */ 
-static bool get_prev_alloc(block_t* block)
+ * profile_dump_next: Writes a profile to the next file named after the
+ *                    prefix given to mm_profile_signal
+ */
+static void profile_dump_next(void)
 {
-    return (block->header & 0x2);
+    char path[sizeof(profile_prefix) + 32];
+
+    snprintf(path, sizeof(path), "%s.%d.%u.heap", profile_prefix,
+             (int)getpid(), __atomic_fetch_add(&profile_seq, 1,
+                                               __ATOMIC_RELAXED));
+    mm_profile_dump(path);
 }
 
 /*
- * free_index: Returns the index of segrgated free list array which 
- *             contains a free list containing blocks of asize <= size
+ * profile_put: Formats into the buffer buf of 4096 bytes holding len bytes,
+ *              writing it to fd first if it is too full. Returns false if a
+ *              write fails.
  */
-size_t free_index(size_t asize)
+static bool profile_put(int fd, char *buf, size_t *len, const char *fmt, ...)
 {
-    if (asize <= 4)
-        return 0;
-    if (asize <= 32)
-        return 1;
-    if (asize <= 64)
-        return 2;
-    if (asize <= 128)
-        return 3;
-    if (asize <= 256)
-        return 4;
-    if (asize <= 512)
-        return 5;
-    if (asize <= 1024)
-        return 6;
-    if (asize <= 2048)
-        return 7;
-    if (asize <= 4096)
-        return 8;
-    if (asize <= 8192)
-        return 9;
-    if (asize <= 16384)
-        return 10;
-    if (asize <= 32768)
-        return 11;
-    if (asize <= 65536)
-        return 12;
-    if (asize <= 131072)
-        return 13;
-    if (asize <= 262144)
-        return 14;
-    if (asize <= 524288)
-        return 15;
-    else 
-        return 16;
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf + *len, 4096 - *len, fmt, ap);
+    va_end(ap);
+    if (n >= 0 && (size_t)n < 4096 - *len)
+    {
+        *len += (size_t)n;
+        return true;
+    }
+
+    if (write(fd, buf, *len) != (ssize_t)*len)
+    {
+        return false;
+    }
+    *len = 0;
+    va_start(ap, fmt);
+    n = vsnprintf(buf, 4096, fmt, ap);
+    va_end(ap);
+    *len = n > 0 ? ((size_t)n < 4096 ? (size_t)n : 4095) : 0;
+    return true;
 }
 
 /*********** END OF STUDENT WRITTEN HELPER FUNCTIONS *********************/
@@ -844,26 +4693,6 @@ static bool get_alloc(block_t *block)
     return extract_alloc(block->header);
 }
 
-/*
- * write_header: given a block and its size and allocation status,
- *               writes an appropriate value to the block header.
- */
-static void write_header(block_t *block, size_t size, bool alloc)
-{
-    block->header = pack(size, alloc);
-}
-
-/*
- * write_footer: given a block and its size and allocation status,
- *               writes an appropriate value to the block footer by first
- *               computing the position of the footer.
- */
-static void write_footer(block_t *block, size_t size, bool alloc)
-{
-    word_t *footerp = (word_t *)((block->payload) + get_size(block) - dsize);
-    *footerp = pack(size, alloc);
-}
-
 /*
  * find_next: returns the next consecutive block on the heap by adding the
  *            size of the block.
@@ -890,17 +4719,27 @@ static word_t *find_prev_footer(block_t *block)
 static block_t *find_prev(block_t *block)
 {
     word_t *footerp = find_prev_footer(block);
+#ifdef COMPACT
+    // A free block of 16 bytes has its links where its footer would be
+    if (*footerp & LINK_TAG)
+    {
+        return (block_t *)((char *)block - dsize);
+    }
+#endif
     size_t size = extract_size(*footerp);
     return (block_t *)((char *)block - size);
 }
 
 /*
  * payload_to_header: given a payload pointer, returns a pointer to the
- *                    corresponding block.
+ *                    corresponding block. The address is computed as an
+ *                    integer, as the compiler takes a pointer returned by
+ *                    malloc for the start of an object and would warn of
+ *                    reading the header in front of it.
  */
 static block_t *payload_to_header(void *bp)
 {
-    return (block_t *)(((char *)bp) - offsetof(block_t, payload));
+    return (block_t *)((uintptr_t)bp - offsetof(block_t, payload));
 }
 
 /*
@@ -925,7 +4764,7 @@ static void *header_to_payload(block_t *block)
  */
 
 static bool in_heap(const void *p) {
-    return p <= mem_heap_hi() && p >= mem_heap_lo();
+    return pagemap_get(p) != 0;
 }
 
 /*
@@ -939,21 +4778,19 @@ static bool aligned(const void *p) {
 
 
 /*
- * correct_ block - Checks if the block is in the heap and if its aligned
- *                  correctly
+ * correct_block - Checks if the block is in the heap and if its payload is
+ *                 aligned correctly
  */
 static bool correct_block(block_t *block)
 {
-    bool inheap = in_heap((void*)block);
-    //bool if_align = aligned((void*)block);
-    if (!inheap)
+    if (!in_heap((void*)block))
     {
-        printf("Block is out of heap bounds\n");
+        check_report("Block %p is out of heap bounds\n", block);
         return false;
     }
-    if (aligned((void*)block))
+    if (!aligned(header_to_payload(block)))
     {
-        printf("Block is not aligned\n");
+        check_report("Block %p is not aligned\n", block);
         return false;
     }
 
@@ -961,55 +4798,565 @@ static bool correct_block(block_t *block)
 }
 
 /*
- * mm_checkheap - Iterates through the heap and checks if each block is correct, 
- *                using the correct_block function
- *              - Checks if blocks are not coalesced
- *              - Checks if free blocks are correct or not using correct_block function
- *              - Iterates through all the free lists and checks if the LSB is set to 0  
+ * check_report: Writes a message of the checks to stderr, formatted on the
+ *               stack, as the checks may run with arena locks held
  */
-bool mm_checkheap(int lineno) {
-    block_t* temp;
-    block_t* block;
+static void check_report(const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0)
+    {
+        n = n < (int)sizeof(buf) ? n : (int)sizeof(buf) - 1;
+        if (write(STDERR_FILENO, buf, (size_t)n) < 0)
+        {
+            return;
+        }
+    }
+}
+
+/*
+ * check_block: Checks the block of arena a and its links to its neighbours:
+ *              its size, owner and flags, the prev_alloc bit of the next
+ *              block, and for a free block its footer, that its neighbours
+ *              are allocated, and that its list links agree with those of
+ *              the blocks they point to and with the head and tail of the
+ *              list its size maps to, in O(1), or that the tree holds it,
+ *              in O(log n).
+ */
+static bool check_block(arena_t *a, block_t *block)
+{
+    block_t *next;
+    block_t *link;
+    word_t footer;
+    size_t size, fl, sl, lfl, lsl;
+
+    if (!correct_block(block))
+    {
+        return false;
+    }
+    size = get_size(block);
+    next = find_next(block);
+    // Check if the block is owned by the arena whose region it is in
+    if (arena_of(block) != a)
+    {
+        check_report("Block %p is not owned by arena %u\n", block, a->id);
+        return false;
+    }
+    // Checks if the block size is at least the minimum and a multiple of 16
+    if (size < min_block_size || size % ALIGNMENT != 0)
+    {
+        check_report("Block %p has a size of %zu\n", block, size);
+        return false;
+    }
+    // Mapped chunks are never part of a region
+    if (get_mapped(block))
+    {
+        check_report("Block %p of the heap is flagged as mapped\n", block);
+        return false;
+    }
+    if (get_prev_alloc(next) != get_alloc(block))
+    {
+        check_report("Block %p after %p has a wrong prev_alloc bit\n",
+                     next, block);
+        return false;
+    }
+    if (get_alloc(block))
+    {
+        return true;
+    }
+
+    // Free blocks have a footer matching their header, but for the 16-byte
+    // blocks of the compact layout, which only have room for their links
+    footer = *find_prev_footer(next);
+    if (size == dsize ? !(footer & LINK_TAG) :
+        extract_size(footer) != size || extract_alloc(footer))
+    {
+        check_report("Footer of free block %p does not match its header\n",
+                     block);
+        return false;
+    }
+    // Check if there are 2 consecutive free blocks - they are not coalesced
+    if (!get_prev_alloc(block) || !get_alloc(next))
+    {
+        check_report("Free block %p is not coalesced with a neighbour\n",
+                     block);
+        return false;
+    }
+
+    // Blocks of the tree are found by searching for them from the root
+    if (size >= TREE_MIN)
+    {
+        for (link = a->tree; link != NULL && link != block;
+             link = *tree_child(link, tree_less(link, block)))
+            ;
+        if (link == NULL)
+        {
+            check_report("Free block %p is not in the tree\n", block);
+            return false;
+        }
+        return true;
+    }
+
+    // The list links agree in both directions, and the ends of the list
+    // are its head and tail
+    free_index(size, &fl, &sl);
+    if ((link = get_prev(block)) == NULL)
+    {
+        if (a->free_listp[fl][sl] != block)
+        {
+            check_report("Free block %p is not in its free list %zu/%zu\n",
+                         block, fl, sl);
+            return false;
+        }
+    }
+    else if (!in_heap(link) || get_alloc(link) || get_next(link) != block)
+    {
+        check_report("Free block %p has a broken prev link\n", block);
+        return false;
+    }
+    else
+    {
+        free_index(get_size(link), &lfl, &lsl);
+        if (lfl != fl || lsl != sl)
+        {
+            check_report("Free block %p is linked to a block of another "
+                         "list\n", block);
+            return false;
+        }
+    }
+    if ((link = get_next(block)) == NULL)
+    {
+        if (a->free_back[fl][sl] != block)
+        {
+            check_report("Free block %p ends a list but is not its tail\n",
+                         block);
+            return false;
+        }
+    }
+    else if (!in_heap(link) || get_alloc(link) || get_prev(link) != block)
+    {
+        check_report("Free block %p has a broken next link\n", block);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * check_tree: Checks the subtree at node of the tree of arena a, whose
+ *             blocks must come after lo and before hi, unless NULL, and have
+ *             at most priority: each is a free block of a of at least
+ *             TREE_MIN bytes. Adds their bytes and counts to those of their
+ *             first level.
+ */
+static bool check_tree(arena_t *a, block_t *node, block_t *lo, block_t *hi,
+                       uint64_t priority, size_t *nbytes, size_t *nblocks)
+{
+    size_t fl, sl;
+
+    // Recurses on the left subtrees only, as deep as the tree
+    for (; node != NULL; lo = node, node = *tree_child(node, true))
+    {
+        if (!correct_block(node) || arena_of(node) != a || get_alloc(node) ||
+            get_size(node) < TREE_MIN || tree_priority(node) > priority ||
+            (lo != NULL && !tree_less(lo, node)) ||
+            (hi != NULL && !tree_less(node, hi)))
+        {
+            check_report("Block %p of the tree is out of order\n", node);
+            return false;
+        }
+        if (!check_tree(a, *tree_child(node, false), lo, node,
+                        tree_priority(node), nbytes, nblocks))
+        {
+            return false;
+        }
+        free_index(get_size(node), &fl, &sl);
+        nbytes[fl] += get_size(node);
+        nblocks[fl]++;
+        priority = tree_priority(node);
+    }
+    return true;
+}
 
-    // Iterating through heap checking if each block satisfies conditions
-    for (temp = heap_listp; get_size(temp) > 0 && temp!=NULL; temp = find_next(temp))
+/*
+ * check_lists: Checks the heads and tails of the free lists of arena a
+ *              against the bitmaps and the lists their sizes map to, and the
+ *              root of the tree, in O(FL_COUNT * SL_COUNT). If walk is true,
+ *              also walks every list and the tree, checking their blocks and
+ *              links and their statistics, in O(free blocks).
+ */
+static bool check_lists(arena_t *a, bool walk)
+{
+    size_t fl, sl, bfl, bsl;
+    size_t tree_bytes[FL_COUNT] = {0}, tree_blocks[FL_COUNT] = {0};
+
+    if (a->tree != NULL && (!correct_block(a->tree) || get_alloc(a->tree) ||
+                            get_size(a->tree) < TREE_MIN))
+    {
+        check_report("Root %p of the tree is broken\n", a->tree);
+        return false;
+    }
+    if (walk && !check_tree(a, a->tree, NULL, NULL, UINT64_MAX, tree_bytes,
+                            tree_blocks))
+    {
+        return false;
+    }
+
+    for (fl = 0; fl < FL_COUNT; fl++)
     {
-        if (!correct_block(temp))
-        { 
+        size_t nbytes = tree_bytes[fl], nblocks = tree_blocks[fl];
+
+        if (((a->fl_bitmap >> fl) & 1) != (a->sl_bitmap[fl] != 0))
+        {
+            check_report("First level bitmap of level %zu is wrong\n", fl);
             return false;
         }
-        //Check if there are 2 consective free blocks - they are not coalesced
-        if (get_alloc(temp) == 0 && get_alloc(find_next(temp)) == 0)
+        for (sl = 0; sl < SL_COUNT; sl++)
+        {
+            block_t *head = a->free_listp[fl][sl];
+            block_t *back = a->free_back[fl][sl];
+            block_t *block, *prev = NULL;
+
+            if (((a->sl_bitmap[fl] >> sl) & 1) != (head != NULL) ||
+                (head == NULL) != (back == NULL))
+            {
+                check_report("Free list %zu/%zu disagrees with its bitmap "
+                             "or tail\n", fl, sl);
+                return false;
+            }
+            if (head == NULL)
+            {
+                continue;
+            }
+            if (!correct_block(head) || !correct_block(back) ||
+                get_alloc(head) || get_alloc(back) ||
+                get_prev(head) != NULL || get_next(back) != NULL)
+            {
+                check_report("Head or tail of free list %zu/%zu is broken\n",
+                             fl, sl);
+                return false;
+            }
+            free_index(get_size(head), &bfl, &bsl);
+            if (bfl != fl || bsl != sl)
+            {
+                check_report("Head %p of free list %zu/%zu belongs to another "
+                             "list\n", head, fl, sl);
+                return false;
+            }
+            if (!walk)
+            {
+                continue;
+            }
+
+            for (block = head; block != NULL; block = get_next(block))
+            {
+                // A cycle would never reach the end of the list
+                if (nblocks++ > a->stats.free_blocks[fl] ||
+                    !correct_block(block))
+                {
+                    check_report("Free list %zu/%zu is broken at %p\n",
+                                 fl, sl, block);
+                    return false;
+                }
+                nbytes += get_size(block);
+                free_index(get_size(block), &bfl, &bsl);
+                // Checking each free block has its alloc bit (LSB) in header
+                // set to 0, is in the list its size maps to, and links back
+                if (get_alloc(block) || bfl != fl || bsl != sl ||
+                    get_prev(block) != prev)
+                {
+                    check_report("Block %p of free list %zu/%zu is wrong\n",
+                                 block, fl, sl);
+                    return false;
+                }
+                prev = block;
+            }
+            if (prev != back)
+            {
+                check_report("Free list %zu/%zu does not end at its tail\n",
+                             fl, sl);
+                return false;
+            }
+        }
+        // The statistics of the free lists match their blocks
+        if (walk && (nbytes != a->stats.free_bytes[fl] ||
+                     nblocks != a->stats.free_blocks[fl]))
         {
-            printf("Two consective blocks %p and %p are not coalesced \n",temp,find_next(temp));  
+            check_report("Free list statistics of level %zu are wrong\n", fl);
             return false;
         }
-        // Checks if the block size is atleast 32
-        if (get_size(temp)<32)
+    }
+    return true;
+}
+
+/*
+ * check_slabs: Checks the free objects of each slab with free objects of
+ *              arena a against its counts
+ */
+static bool check_slabs(arena_t *a)
+{
+    for (size_t cls = 0; cls < SLAB_CLASSES; cls++)
+    {
+        for (slab_t *slab = a->slab_partial[cls]; slab != NULL;
+             slab = slab->next)
+        {
+            size_t nfree = 0;
+            for (size_t word = 0; word < SLAB_MAP_WORDS; word++)
+            {
+                nfree += __builtin_popcountll(slab->freemap[word]);
+            }
+            if (slab->size != (cls + 1) * 16 || slab->used >= slab->count ||
+                nfree != (size_t)(slab->count - slab->used) ||
+                !(pagemap_get(slab) & PM_SLAB))
+            {
+                check_report("Slab %p of class %zu is inconsistent\n",
+                             slab, cls);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * check_quick: Checks that each quick list of arena a holds as many blocks
+ *              as its count, allocated, of its size and owned by a
+ */
+static bool check_quick(arena_t *a)
+{
+    size_t nbytes = 0, nblocks = 0;
+
+    for (size_t bin = 0; bin < QUICK_BINS; bin++)
+    {
+        size_t size = bin * 16 + min_block_size;
+        size_t n = 0;
+
+        for (block_t *block = a->quick[bin]; block != NULL;
+             block = *(block_t **)block->payload)
+        {
+            // A cycle would never reach the end of the list
+            if (n++ == a->quick_count[bin] || !correct_block(block) ||
+                (pagemap_get(block) & PM_ARENA) != a->id + 1u ||
+                !get_alloc(block) || get_size(block) != size)
+            {
+                check_report("Block %p of quick list %zu is wrong\n",
+                             block, bin);
+                return false;
+            }
+        }
+        if (n != a->quick_count[bin])
         {
-            printf("Block size of block %p is less than 32\n", temp);
+            check_report("Quick list %zu holds %zu blocks rather than %u\n",
+                         bin, n, a->quick_count[bin]);
             return false;
         }
+        nbytes += n * size;
+        nblocks += n;
+    }
+    if (nbytes != a->stats.quick_bytes || nblocks != a->stats.quick_blocks)
+    {
+        check_report("Quick list statistics of arena %u are wrong\n", a->id);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * check_arena: Runs the checks of level on arena a, whose lock must be held
+ *              or no other thread running. MM_CHECK_CHEAP checks the heads
+ *              and tails of the free lists, MM_CHECK_MEDIUM walks the free
+ *              lists, quick lists and slabs, and MM_CHECK_FULL walks every
+ *              block of the regions, which must hold as many free blocks as
+ *              the lists.
+ */
+static bool check_arena(arena_t *a, int level)
+{
+    size_t nfree = 0, nlisted = 0;
 
+    if (!check_lists(a, level >= MM_CHECK_MEDIUM))
+    {
+        return false;
+    }
+    if (level < MM_CHECK_MEDIUM)
+    {
+        return true;
+    }
+    if (!check_slabs(a) || !check_quick(a))
+    {
+        return false;
+    }
+    if (level < MM_CHECK_FULL)
+    {
+        return true;
     }
 
-    // Checking each free block has its alloc bit (LSB) in header set to 0
-    for(size_t i = 0; i < LIMIT; i++)
+    for (region_t *region = a->regions; region != NULL; region = region->next)
     {
-      for (block = free_listp[i]; block!=NULL ; block = get_next(block))
-      {
-        // Checking each free block has its alloc bit (LSB) in header set to 0
-        if (get_alloc(block) == true)
+        block_t *block = region_first_block(region);
+
+        // The block after the prologue has its prev_alloc bit set
+        if (!get_prev_alloc(block))
         {
+            check_report("First block %p of region %p has a wrong prev_alloc "
+                         "bit\n", block, region);
             return false;
         }
-        // Checking if the block is within heap bounds 
-        if (!correct_block(block))
+        for (; get_size(block) > 0; block = find_next(block))
+        {
+            if (!check_block(a, block))
+            {
+                return false;
+            }
+            nfree += !get_alloc(block);
+        }
+        // The epilogue ends the region, as an allocated block of size 0
+        if (!get_alloc(block) || (char *)block + wsize !=
+                                 (char *)region + region->size)
         {
+            check_report("Epilogue %p of region %p is broken\n", block, region);
             return false;
-        } 
+        }
+    }
+    // Every free block of the heap is in a list, as the links of each are
+    // checked, and no list holds a block outside the heap
+    for (size_t fl = 0; fl < FL_COUNT; fl++)
+    {
+        nlisted += a->stats.free_blocks[fl];
+    }
+    if (nfree != nlisted)
+    {
+        check_report("Arena %u has %zu free blocks but %zu in its lists\n",
+                     a->id, nfree, nlisted);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * check_step: Runs the incremental check of arena a, whose lock must be
+ *             held: the cheap checks, then check_block on the next
+ *             check_slice blocks from the cursor of a, wrapping around its
+ *             regions. Reports the failure and aborts if one fails.
+ */
+static void check_step(arena_t *a)
+{
+    block_t *block = a->check_cursor;
+    region_t *region = a->check_region;
+    bool ok = check_lists(a, false);
+
+    a->check_ticks = 0;
+    if (block == NULL && (region = a->regions) != NULL)
+    {
+        block = region_first_block(region);
+    }
+    for (size_t n = 0; ok && block != NULL && n < check_slice; n++)
+    {
+        ok = check_block(a, block);
+        block = find_next(block);
+        // The cursor never rests on an epilogue, which trimming moves
+        if (get_size(block) == 0)
+        {
+            region = region->next != NULL ? region->next : a->regions;
+            block = region_first_block(region);
+        }
+    }
+    a->check_cursor = block;
+    a->check_region = region;
+
+    if (!ok)
+    {
+        check_report("Incremental heap check of arena %u failed\n", a->id);
+        abort();
+    }
+}
+
+/*
+ * check_merged: Moves the cursor of the incremental check of arena a back
+ *               to the start of block if it pointed inside it, as after
+ *               block absorbed its neighbours
+ */
+static void check_merged(arena_t *a, block_t *block)
+{
+    if ((char *)a->check_cursor > (char *)block &&
+        (char *)a->check_cursor < (char *)block + get_size(block))
+    {
+        a->check_cursor = block;
+    }
+}
+
+/*
+ * check_env_init: Turns incremental checks on if MM_CHECK holds an interval,
+ *                 optionally followed by a comma and a slice, as taken by
+ *                 mm_set_check
+ */
+static void check_env_init(void)
+{
+    const char *env = getenv("MM_CHECK");
+    char *end;
+    size_t interval;
+
+    if (env == NULL)
+    {
+        return;
+    }
+    interval = strtoul(env, &end, 0);
+    mm_set_check(interval, *end == ',' ? strtoul(end + 1, NULL, 0) : 0);
+}
+
+/*
+ * mm_check: Runs the checks of level, MM_CHECK_CHEAP, MM_CHECK_MEDIUM or
+ *           MM_CHECK_FULL, on every arena in turn, under its lock, so it can
+ *           run while other threads allocate. Returns false, after
+ *           reporting the failure to stderr, if a check fails.
+ */
+bool mm_check(int level)
+{
+    bool ok = true;
 
-      }
+    for (size_t i = 0; ok && i < MAX_ARENAS; i++)
+    {
+        pthread_mutex_lock(&arenas[i].lock);
+        ok = check_arena(&arenas[i], level);
+        pthread_mutex_unlock(&arenas[i].lock);
+    }
+    return ok;
+}
+
+/*
+ * mm_set_check: Makes every interval-th free or allocation of an arena run
+ *               the cheap checks and check the next slice blocks of that
+ *               arena, CHECK_SLICE if slice is 0, aborting if a check fails.
+ *               An interval of 0 turns the checks off.
+ */
+void mm_set_check(size_t interval, size_t slice)
+{
+    check_slice = slice != 0 ? slice : CHECK_SLICE;
+    __atomic_store_n(&check_interval, interval, __ATOMIC_RELAXED);
+}
+
+/*
+ * mm_checkheap - Runs every check, MM_CHECK_FULL, on every arena:
+ *              - Checks that each block of the regions is correct, using the
+ *                correct_block function, owned by the arena, and coalesced
+ *              - Checks the prev_alloc bits, and the footers and list links
+ *                of free blocks
+ *              - Walks all the free lists, checking their blocks, tails and
+ *                statistics, and the slabs
+ *              Must not run concurrently with other calls
+ */
+bool mm_checkheap(int lineno) {
+    for (size_t i = 0; i < MAX_ARENAS; i++)
+    {
+        if (!check_arena(&arenas[i], MM_CHECK_FULL))
+        {
+            check_report("mm_checkheap failed at line %d\n", lineno);
+            return false;
+        }
     }
 
     return true;
@@ -8,6 +8,12 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t align, size_t size);
+extern void *mm_aligned_alloc(size_t align, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern void *mm_valloc(size_t size);
+extern void *mm_pvalloc(size_t size);
+extern size_t mm_malloc_usable_size(void *ptr);
 
 #else
 
@@ -16,10 +22,124 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern int posix_memalign(void **memptr, size_t align, size_t size);
+extern void *aligned_alloc(size_t align, size_t size);
+extern void *memalign(size_t align, size_t size);
+extern void *valloc(size_t size);
+extern void *pvalloc(size_t size);
+extern size_t malloc_usable_size(void *ptr);
 
 #endif
 
 extern bool mm_init(void);
 
+/* Buckets of struct mm_stats, one per power of two of free block sizes */
+#define MM_STATS_BUCKETS 41
+
+/* Statistics of the allocator, as filled in by mm_stats */
+struct mm_stats
+{
+    size_t heap_bytes;          // bytes of the heap regions
+    size_t mapped_bytes;        // bytes of the mapped chunks
+    size_t mapped_chunks;       // number of mapped chunks
+    size_t live_bytes;          // bytes of blocks, slab objects and chunks
+                                // in use, headers included
+    size_t free_bytes;          // bytes of the free blocks
+    size_t free_blocks;         // number of free blocks
+    size_t quick_bytes;         // bytes of the blocks parked in quick lists
+    size_t quick_blocks;        // number of blocks parked in quick lists
+    size_t largest_free;        // size of the largest free block
+    size_t slab_bytes;          // bytes of the slab spans
+    size_t slab_used_bytes;     // bytes of the slab objects in use
+    size_t slab_objects;        // number of slab objects in use
+    size_t extend_calls;        // times the heap was extended
+    size_t coalesce[4];         // blocks freed joined with no neighbour,
+                                // the next, the previous and both of them
+    size_t splits;              // free blocks split to serve a request
+    size_t bucket_bytes[MM_STATS_BUCKETS];  // free bytes of 2^(i+7) up to
+                                            // 2^(i+8) byte blocks, below
+                                            // 256 bytes for bucket 0
+    size_t bucket_blocks[MM_STATS_BUCKETS]; // free blocks of the same
+};
+
+/* Frees ptr given a size between the size requested and its usable size */
+extern void mm_free_sized(void *ptr, size_t size);
+
+/* Allocates at least size bytes and stores the usable size in *actual */
+extern void *mm_malloc_at_least(size_t size, size_t *actual);
+
+/* Allocates n objects of size bytes into ptrs, returns how many were */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **ptrs);
+
+/* Frees the n objects of ptrs at once, overwriting ptrs */
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/* Sets the number of arenas and how threads are assigned to them */
+extern void mm_set_arenas(size_t count, bool by_cpu);
+
+/* Sets the largest request served from headerless slabs, 0 disables them */
+extern void mm_set_slab_limit(size_t size);
+
+/* Sets how many freed blocks of a size park uncoalesced, 0 disables it */
+extern void mm_set_quick(size_t count);
+
+/* Orders of the free lists for mm_set_policy */
+#define MM_ORDER_FIFO 0     /* freed blocks go to the back */
+#define MM_ORDER_LIFO 1     /* freed blocks go to the front */
+#define MM_ORDER_ADDRESS 2  /* blocks are sorted by address */
+
+/* Searches of the free lists for mm_set_policy */
+#define MM_FIT_GOOD 0       /* the head of the list, else a larger class */
+#define MM_FIT_FIRST 1      /* the first block that fits */
+#define MM_FIT_BEST 2       /* the smallest block that fits */
+#define MM_FIT_NEXT 3       /* the first that fits after the last one taken */
+
+/* Sets the order and search of the free lists, scanning scan blocks */
+extern bool mm_set_policy(int order, int search, size_t scan);
+
+/* Sets the smallest request given its own mapping, 0 disables mapping */
+extern void mm_set_mmap_threshold(size_t size, bool dynamic);
+
+/* Gives free memory at the end of the heap back, keeping pad bytes */
+extern bool mm_trim(size_t pad);
+
+/* Releases the pages of every large free block, returns the bytes released */
+extern size_t mm_purge(void);
+
+/* Sets how long large free blocks stay before being released, -1 for never */
+extern void mm_set_decay(long ms);
+
+/* Sets the per-thread cache capacity of the size class serving size bytes */
+extern bool mm_tcache_set_capacity(size_t size, size_t count);
+
+/* Fills st with the statistics of the allocator */
+extern void mm_stats(struct mm_stats *st);
+
+/* Writes the statistics of the allocator to f as a JSON object */
+extern void mm_stats_json(FILE *f);
+
+/* Starts sampling a request about every rate bytes for the heap profile */
+extern bool mm_profile_start(size_t rate);
+
+/* Stops sampling requests for the heap profile */
+extern void mm_profile_stop(void);
+
+/* Writes the heap profile to path in the format read by pprof */
+extern bool mm_profile_dump(const char *path);
+
+/* Makes signal signo write a heap profile to prefix.<pid>.<n>.heap */
+extern bool mm_profile_signal(int signo, const char *prefix);
+
+/* Levels of mm_check, each adding to the checks of the previous one */
+#define MM_CHECK_CHEAP 0    /* heads and tails of the free lists */
+#define MM_CHECK_MEDIUM 1   /* every free list, quick list and slab */
+#define MM_CHECK_FULL 2     /* every block of the heap */
+
+/* Checks the heap at level while other threads run, false if it is broken */
+extern bool mm_check(int level);
+
+/* Checks slice blocks every interval operations of an arena, 0 turns off */
+extern void mm_set_check(size_t interval, size_t slice);
+
 /* This is for debugging.  Returns false if error encountered */
 extern bool mm_checkheap(int lineno);
@@ -0,0 +1,171 @@
+/*
+ * aligned.c: Checks the alignment of the aligned allocation family. Blocks
+ *            from posix_memalign, aligned_alloc and memalign, for every
+ *            power of two alignment from 8 bytes to 4 MiB and a range of
+ *            sizes, and from valloc and pvalloc, must be aligned, hold their
+ *            size, keep their contents while the others are allocated, and
+ *            survive realloc. A few huge alignments are allocated on their
+ *            own, and invalid alignments must be rejected.
+ *
+ * Build:  make tests/aligned
+ * Usage:  tests/aligned
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define MIN_SHIFT 3
+#define MAX_SHIFT 22
+#define MAX_LIVE 1024
+
+static const size_t sizes[] = { 1, 24, 100, 1000, 5000, 100000 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+static const size_t huge[] = { (size_t)1 << 24, (size_t)1 << 25 };
+#define NHUGE (sizeof(huge) / sizeof(huge[0]))
+
+static char *live[MAX_LIVE];
+static size_t live_size[MAX_LIVE];
+static size_t nlive;
+
+/*
+ * keep: Checks that p is a multiple of align and holds size bytes, then
+ *       fills it with the pattern of its index and keeps it. Returns 0 if
+ *       it does not.
+ */
+static int keep(void *p, size_t align, size_t size)
+{
+    if (p == NULL || (uintptr_t)p % align != 0 ||
+        mm_malloc_usable_size(p) < size || nlive == MAX_LIVE)
+    {
+        fprintf(stderr, "%p of %zu bytes is not aligned to %zu\n", p, size,
+                align);
+        return 0;
+    }
+    memset(p, (int)(nlive & 0xff), size);
+    live[nlive] = p;
+    live_size[nlive++] = size;
+    return 1;
+}
+
+/*
+ * intact: Returns 1 if block i still holds its pattern at both ends
+ */
+static int intact(size_t i)
+{
+    return live[i][0] == (char)(i & 0xff) &&
+           live[i][live_size[i] - 1] == (char)(i & 0xff);
+}
+
+/*
+ * resize: Reallocates block i to size bytes, no fewer than it holds, and
+ *         returns 1 if it still holds its pattern
+ */
+static int resize(size_t i, size_t size)
+{
+    char *p = mm_realloc(live[i], size);
+
+    if (p == NULL)
+    {
+        return 0;
+    }
+    live[i] = p;
+    return intact(i);
+}
+
+int main(void)
+{
+    size_t page = mem_pagesize();
+    void *p = NULL;
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    for (size_t shift = MIN_SHIFT; shift <= MAX_SHIFT; shift++)
+    {
+        size_t align = (size_t)1 << shift;
+
+        for (size_t s = 0; s < NSIZES; s++)
+        {
+            if (mm_posix_memalign(&p, align, sizes[s]) != 0 ||
+                !keep(p, align, sizes[s]) ||
+                !keep(mm_aligned_alloc(align, sizes[s]), align, sizes[s]) ||
+                !keep(mm_memalign(align, sizes[s]), align, sizes[s]))
+            {
+                return 1;
+            }
+        }
+    }
+    for (size_t s = 0; s < NSIZES; s++)
+    {
+        if (!keep(mm_valloc(sizes[s]), page, sizes[s]) ||
+            !keep(mm_pvalloc(sizes[s]), page,
+                  (sizes[s] + page - 1) / page * page))
+        {
+            return 1;
+        }
+    }
+
+    // Growing and shrinking keeps the data, if not the alignment
+    for (size_t i = 0; i < nlive; i++)
+    {
+        if (!intact(i))
+        {
+            fprintf(stderr, "block %zu at %p was overwritten\n", i,
+                    (void *)live[i]);
+            return 1;
+        }
+        if (!resize(i, live_size[i] * 2) || !resize(i, live_size[i]))
+        {
+            fprintf(stderr, "realloc lost the data of block %zu\n", i);
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < nlive; i++)
+    {
+        mm_free(live[i]);
+    }
+    nlive = 0;
+
+    for (size_t h = 0; h < NHUGE; h++)
+    {
+        if (mm_posix_memalign(&p, huge[h], 100) != 0 ||
+            !keep(p, huge[h], 100))
+        {
+            return 1;
+        }
+        mm_free(live[--nlive]);
+    }
+
+    // Alignments that are not powers of two, or below a pointer
+    p = NULL;
+    if (mm_posix_memalign(&p, 24, 100) != EINVAL ||
+        mm_posix_memalign(&p, 4, 100) != EINVAL || p != NULL ||
+        mm_aligned_alloc(24, 100) != NULL || errno != EINVAL)
+    {
+        fprintf(stderr, "an invalid alignment was accepted\n");
+        return 1;
+    }
+    // memalign rounds the alignment up to a power of two
+    if (!keep(mm_memalign(24, 100), 32, 100))
+    {
+        return 1;
+    }
+    mm_free(live[--nlive]);
+
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+    printf("aligned ok\n");
+    return 0;
+}
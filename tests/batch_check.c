@@ -0,0 +1,87 @@
+/*
+ * batch_check.c: Checks that mm_free_batch keeps the incremental heap check
+ *                consistent. Rounds of mm_malloc_batch allocate runs of
+ *                adjacent blocks, and mm_free_batch frees random halves of
+ *                them, joining neighbours, while every allocation and free
+ *                checks a slice of the heap, which aborts if the cursor of
+ *                the check was left inside a joined block.
+ *
+ * Build:  make tests/batch_check
+ * Usage:  tests/batch_check [rounds = 2000]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define BATCH 64
+#define MAX_LIVE 4096
+
+static void *live[MAX_LIVE];
+static size_t nlive;
+
+/*
+ * rnd: Returns a pseudo-random number below n, from a xorshift generator
+ */
+static uint64_t rnd(uint64_t n)
+{
+    static uint64_t seed = 0x9e3779b97f4a7c15ull;
+
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed % n;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    void *ptrs[MAX_LIVE];
+    size_t n;
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+    mm_set_check(1, 8);
+
+    for (int r = 0; r < rounds; r++)
+    {
+        // Sizes from slab objects to blocks the thread cache does not hold
+        size_t size = 16 + rnd(3000);
+
+        if (nlive + BATCH <= MAX_LIVE)
+        {
+            nlive += mm_malloc_batch(size, BATCH, live + nlive);
+        }
+
+        // Frees a random half of the live blocks, many of them neighbours
+        n = 0;
+        for (size_t i = 0; i < nlive; )
+        {
+            if (rnd(2) == 0)
+            {
+                ptrs[n++] = live[i];
+                live[i] = live[--nlive];
+            }
+            else
+            {
+                i++;
+            }
+        }
+        mm_free_batch(ptrs, n);
+    }
+    mm_free_batch(live, nlive);
+
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+    printf("batch_check ok\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * calloc_zero.c: Checks that calloc returns zeroed memory wherever its block
+ *                comes from. Blocks of sizes from slab objects up to ranges
+ *                calloc remaps are written and freed, then allocated again
+ *                by calloc as they are, after mm_purge released their pages
+ *                and after mm_trim, and must read as zero. A random mix of
+ *                written blocks, calloc blocks and purges follows, which
+ *                splits and joins the purged blocks with the others.
+ *
+ * Build:  make tests/calloc_zero
+ * Usage:  tests/calloc_zero [steps = 20000]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define DIRT 0xaa
+#define NSLOTS 64
+#define PURGE_STEPS 1000            // steps between purges of the mix
+
+static const size_t sizes[] = { 16, 200, 1000, 3000, 40000, 300000,
+                                5 << 20 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static char *slot[NSLOTS];
+
+/*
+ * dirty: Allocates a block of size bytes with malloc and writes all of it.
+ *        Returns NULL on failure.
+ */
+static char *dirty(size_t size)
+{
+    char *p = mm_malloc(size);
+
+    if (p != NULL)
+    {
+        memset(p, DIRT, mm_malloc_usable_size(p));
+    }
+    return p;
+}
+
+/*
+ * zeroed: Allocates a block of size bytes with calloc and returns it if all
+ *         of them are zero, else reports it and returns NULL
+ */
+static char *zeroed(size_t size)
+{
+    char *p = mm_calloc(1, size);
+
+    for (size_t i = 0; p != NULL && i < size; i++)
+    {
+        if (p[i] != 0)
+        {
+            fprintf(stderr, "byte %zu of %zu from calloc at %p is not zero\n",
+                    i, size, (void *)p);
+            return NULL;
+        }
+    }
+    return p;
+}
+
+/*
+ * round_trip: Writes and frees a block of each size, runs release unless
+ *             it is NULL, then checks that calloc zeroes the same sizes.
+ *             Returns 0 on failure.
+ */
+static int round_trip(const char *what, void (*release)(void))
+{
+    char *p[NSIZES];
+
+    for (size_t s = 0; s < NSIZES; s++)
+    {
+        if ((p[s] = dirty(sizes[s])) == NULL)
+        {
+            fprintf(stderr, "mm_malloc failed\n");
+            return 0;
+        }
+    }
+    for (size_t s = 0; s < NSIZES; s++)
+    {
+        mm_free(p[s]);
+    }
+    if (release != NULL)
+    {
+        release();
+    }
+    for (size_t s = 0; s < NSIZES; s++)
+    {
+        if ((p[s] = zeroed(sizes[s])) == NULL)
+        {
+            fprintf(stderr, "calloc failed after %s\n", what);
+            return 0;
+        }
+    }
+    for (size_t s = 0; s < NSIZES; s++)
+    {
+        mm_free(p[s]);
+    }
+    return 1;
+}
+
+/*
+ * purge: Releases the pages of every free block
+ */
+static void purge(void)
+{
+    mm_purge();
+}
+
+/*
+ * trim: Releases the free memory at the end of the heap
+ */
+static void trim(void)
+{
+    mm_trim(0);
+}
+
+int main(int argc, char **argv)
+{
+    size_t steps = argc > 1 ? (size_t)atol(argv[1]) : 20000;
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    if (!round_trip("free", NULL) || !round_trip("mm_purge", purge) ||
+        !round_trip("mm_trim", trim))
+    {
+        return 1;
+    }
+
+    // Mostly small blocks, some large and a few past CALLOC_REMAP
+    srand(1);
+    for (size_t step = 1; step <= steps; step++)
+    {
+        size_t i = (size_t)rand() % NSLOTS;
+        size_t size = (size_t)rand() % 4096 + 1;
+        int r = rand() % 1000;
+
+        if (r < 2)
+        {
+            size = sizes[NSIZES - 1] + (size_t)rand() % 4096;
+        }
+        else if (r < 100)
+        {
+            size *= 64;
+        }
+
+        if (slot[i] != NULL)
+        {
+            mm_free(slot[i]);
+            slot[i] = NULL;
+        }
+        else if ((slot[i] = rand() % 2 ? dirty(size) : zeroed(size)) == NULL)
+        {
+            fprintf(stderr, "step %zu of %zu bytes failed\n", step, size);
+            return 1;
+        }
+        if (step % PURGE_STEPS == 0)
+        {
+            mm_purge();
+        }
+    }
+    for (size_t i = 0; i < NSLOTS; i++)
+    {
+        mm_free(slot[i]);
+    }
+
+    // Sizes whose product overflows are refused
+    if (mm_calloc(SIZE_MAX / 2, 3) != NULL)
+    {
+        fprintf(stderr, "calloc of an overflowing size succeeded\n");
+        return 1;
+    }
+
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+    printf("calloc_zero ok\n");
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * profile.c: Checks the sample counts of the heap profile and its heap_v2
+ *            dump. Blocks and slab-sized objects are allocated while
+ *            sampling at a small rate, and the dump must hold about as many
+ *            live samples as the rate predicts, each on a call stack line,
+ *            followed by the mappings of the process. Once the blocks are
+ *            freed through free, mm_free_sized, mm_free_batch and realloc,
+ *            no sample may stay live, and no request may be sampled after
+ *            sampling stops.
+ *
+ * Build:  make tests/profile
+ * Usage:  tests/profile
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define RATE 4096
+#define NOBJS 20000
+
+static const size_t sizes[] = { 1000, 64 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static void *objs[NSIZES][NOBJS];
+
+typedef struct profile
+{
+    size_t live_count, live_bytes;
+    size_t total_count, total_bytes;
+    size_t rate;
+    size_t stack_count;     // live samples over the call stack lines
+    int mapped;             // the mappings follow the stacks
+} profile_t;
+
+/*
+ * dump: Writes the heap profile to path and reads it back into p. Returns 0
+ *       on failure.
+ */
+static int dump(const char *path, profile_t *p)
+{
+    char line[4096];
+    size_t count, bytes, tcount, tbytes;
+    FILE *f;
+
+    memset(p, 0, sizeof(*p));
+    if (!mm_profile_dump(path) || (f = fopen(path, "r")) == NULL)
+    {
+        return 0;
+    }
+    if (fscanf(f, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+               &p->live_count, &p->live_bytes, &p->total_count,
+               &p->total_bytes, &p->rate) != 5)
+    {
+        fclose(f);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (sscanf(line, "%zu: %zu [%zu: %zu] @ 0x", &count, &bytes,
+                   &tcount, &tbytes) == 4)
+        {
+            p->stack_count += count;
+        }
+        else if (strcmp(line, "MAPPED_LIBRARIES:\n") == 0)
+        {
+            p->mapped = 1;
+        }
+    }
+    fclose(f);
+    return 1;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/mm-profile-XXXXXX";
+    profile_t p, freed, stopped;
+    double expected = 0;
+    size_t n;
+    int fd;
+
+    mem_init();
+    if (!mm_init() || (fd = mkstemp(path)) < 0)
+    {
+        fprintf(stderr, "initialization failed\n");
+        return 1;
+    }
+    close(fd);
+
+    if (!mm_profile_start(RATE))
+    {
+        fprintf(stderr, "mm_profile_start failed\n");
+        return 1;
+    }
+    for (size_t s = 0; s < NSIZES; s++)
+    {
+        for (size_t i = 0; i < NOBJS; i++)
+        {
+            if ((objs[s][i] = mm_malloc(sizes[s])) == NULL)
+            {
+                fprintf(stderr, "mm_malloc failed\n");
+                return 1;
+            }
+        }
+        // A request of size bytes is sampled with this probability
+        expected += NOBJS * (1 - exp(-(double)sizes[s] / RATE));
+    }
+
+    if (!dump(path, &p))
+    {
+        fprintf(stderr, "the profile could not be written or read\n");
+        return 1;
+    }
+    if (p.rate != RATE || !p.mapped || p.stack_count != p.live_count ||
+        p.total_count != p.live_count)
+    {
+        fprintf(stderr, "the profile is malformed\n");
+        return 1;
+    }
+    if (fabs((double)p.live_count - expected) > expected / 10 ||
+        p.live_bytes < p.live_count * sizes[NSIZES - 1] ||
+        p.live_bytes > p.live_count * sizes[0])
+    {
+        fprintf(stderr, "%zu samples of %zu bytes, %.0f expected\n",
+                p.live_count, p.live_bytes, expected);
+        return 1;
+    }
+
+    // Each way of freeing drops the samples it frees
+    n = NOBJS / 4;
+    for (size_t i = 0; i < n; i++)
+    {
+        mm_free(objs[0][i]);
+        mm_free_sized(objs[0][n + i], sizes[0]);
+        mm_free(mm_realloc(objs[0][2 * n + i], 2 * sizes[0]));
+    }
+    mm_free_batch(objs[0] + 3 * n, NOBJS - 3 * n);
+    mm_free_batch(objs[1], NOBJS);
+    mm_profile_stop();
+    if (!dump(path, &freed) || freed.live_count != 0 ||
+        freed.live_bytes != 0 || freed.total_count < p.total_count)
+    {
+        fprintf(stderr, "%zu samples of %zu bytes stayed live\n",
+                freed.live_count, freed.live_bytes);
+        return 1;
+    }
+
+    for (size_t i = 0; i < NOBJS; i++)
+    {
+        mm_free(mm_malloc(sizes[0]));
+    }
+    if (!dump(path, &stopped) || stopped.total_count != freed.total_count)
+    {
+        fprintf(stderr, "requests were sampled after mm_profile_stop\n");
+        return 1;
+    }
+    unlink(path);
+
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+    printf("profile ok\n");
+    return 0;
+}
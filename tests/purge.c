@@ -0,0 +1,162 @@
+/*
+ * purge.c: Checks that free memory is given back to the system by mm_trim,
+ *          mm_purge and the decay of free blocks. Large blocks are written
+ *          and freed, at the end of the heap for mm_trim and between small
+ *          blocks kept allocated for mm_purge and the decay, and the
+ *          resident memory of the process must drop by most of their size.
+ *          Under DRIVER the break is never lowered, so mm_trim releases the
+ *          pages of the last free block instead.
+ *
+ * Build:  make tests/purge
+ * Usage:  tests/purge
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define BIG_SIZE ((size_t)1 << 20)
+#define NBIG 64
+#define GUARD_SIZE 2000             // above the thread cache
+#define PURGE_TICKS 1024            // frees between clock checks, as in mm.c
+
+static char *big[NBIG];
+static void *guard[NBIG];
+
+/*
+ * resident: Returns the resident memory of the process in bytes
+ */
+static size_t resident(void)
+{
+    unsigned long size, pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f != NULL)
+    {
+        if (fscanf(f, "%lu %lu", &size, &pages) != 2)
+        {
+            pages = 0;
+        }
+        fclose(f);
+    }
+    return pages * mem_pagesize();
+}
+
+/*
+ * alloc_big: Allocates and writes the large blocks, each followed by a small
+ *            block if guarded. Returns 0 on failure.
+ */
+static int alloc_big(int guarded)
+{
+    for (size_t i = 0; i < NBIG; i++)
+    {
+        if ((big[i] = mm_malloc(BIG_SIZE)) == NULL ||
+            (guarded && guard[i] == NULL &&
+             (guard[i] = mm_malloc(GUARD_SIZE)) == NULL))
+        {
+            return 0;
+        }
+        memset(big[i], 1, BIG_SIZE);
+    }
+    return 1;
+}
+
+/*
+ * free_big: Frees the large blocks and returns the resident memory after
+ */
+static size_t free_big(void)
+{
+    for (size_t i = 0; i < NBIG; i++)
+    {
+        mm_free(big[i]);
+    }
+    return resident();
+}
+
+/*
+ * released: Returns 1 if the resident memory dropped from before by at least
+ *           half the bytes of the large blocks, else reports what did not
+ */
+static int released(const char *what, size_t before)
+{
+    size_t after = resident();
+
+    if (after + NBIG * BIG_SIZE / 2 > before)
+    {
+        fprintf(stderr, "%s released %zu of %zu bytes\n", what,
+                before > after ? before - after : 0, NBIG * BIG_SIZE);
+        return 0;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    size_t before;
+    void *p;
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    // The large blocks join the free space at the end of the heap
+    if (!alloc_big(0))
+    {
+        fprintf(stderr, "mm_malloc failed\n");
+        return 1;
+    }
+    before = free_big();
+    if (!mm_trim(0) || !released("mm_trim", before))
+    {
+        return 1;
+    }
+
+    // The small blocks keep the large ones apart when they are freed
+    if (!alloc_big(1))
+    {
+        fprintf(stderr, "mm_malloc failed\n");
+        return 1;
+    }
+    before = free_big();
+    if (mm_purge() < NBIG * BIG_SIZE / 2 || !released("mm_purge", before))
+    {
+        return 1;
+    }
+
+    // Blocks free for a whole epoch are released by the frees that follow
+    mm_set_decay(0);
+    if (!alloc_big(1) || (p = mm_malloc(GUARD_SIZE)) == NULL)
+    {
+        fprintf(stderr, "mm_malloc failed\n");
+        return 1;
+    }
+    before = free_big();
+    for (size_t i = 0; i < 4 * PURGE_TICKS && p != NULL; i++)
+    {
+        mm_free(p);
+        p = mm_malloc(GUARD_SIZE);
+    }
+    if (!released("the decay", before))
+    {
+        return 1;
+    }
+    mm_free(p);
+    for (size_t i = 0; i < NBIG; i++)
+    {
+        mm_free(guard[i]);
+    }
+
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+    printf("purge ok\n");
+    return 0;
+}
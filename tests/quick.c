@@ -0,0 +1,148 @@
+/*
+ * quick.c: Checks that freed blocks small enough for the quick lists are
+ *          parked there and reused, and that the lists are coalesced into
+ *          the free lists when they grow past their limit, on mm_purge and
+ *          on mm_set_quick. Blocks above the thread cache are freed in a
+ *          row, and the statistics of mm_stats must count each of them as
+ *          parked until its list is flushed.
+ *
+ * Build:  make tests/quick
+ * Usage:  tests/quick
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define QUICK_COUNT 32              // default quick_limit, as in mm.c
+#define BLOCK_SIZE 1500             // above the thread cache and slabs
+#define NBLOCKS 40
+#define NFREED 10
+
+static void *blocks[NBLOCKS];
+
+/*
+ * parked: Returns the number of blocks parked in the quick lists
+ */
+static size_t parked(void)
+{
+    struct mm_stats st;
+
+    mm_stats(&st);
+    return st.quick_blocks;
+}
+
+/*
+ * fill: Allocates the blocks from i on. Returns 0 on failure.
+ */
+static int fill(size_t i)
+{
+    for (; i < NBLOCKS; i++)
+    {
+        if ((blocks[i] = mm_malloc(BLOCK_SIZE)) == NULL)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(void)
+{
+    struct mm_stats before, after;
+    size_t n;
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    if (!fill(0))
+    {
+        fprintf(stderr, "mm_malloc failed\n");
+        return 1;
+    }
+    mm_stats(&before);
+    for (size_t i = 0; i < NFREED; i++)
+    {
+        mm_free(blocks[i]);
+    }
+    mm_stats(&after);
+    if (after.quick_blocks != before.quick_blocks + NFREED ||
+        after.free_blocks != before.free_blocks ||
+        after.live_bytes + after.quick_bytes - before.quick_bytes !=
+            before.live_bytes)
+    {
+        fprintf(stderr, "%zu of %zu freed blocks were parked\n",
+                after.quick_blocks - before.quick_blocks, (size_t)NFREED);
+        return 1;
+    }
+
+    // The last block parked is the first one taken back
+    for (size_t i = NFREED; i-- > 0;)
+    {
+        if (mm_malloc(BLOCK_SIZE) != blocks[i])
+        {
+            fprintf(stderr, "block %zu was not reused\n", i);
+            return 1;
+        }
+    }
+    if (parked() != before.quick_blocks)
+    {
+        fprintf(stderr, "reused blocks stayed parked\n");
+        return 1;
+    }
+
+    // The list is coalesced as a whole once it holds one block too many
+    for (size_t i = 0; i < NBLOCKS; i++)
+    {
+        mm_free(blocks[i]);
+    }
+    n = parked() - before.quick_blocks;
+    if (n != NBLOCKS % (QUICK_COUNT + 1))
+    {
+        fprintf(stderr, "%zu blocks parked past the limit\n", n);
+        return 1;
+    }
+    mm_purge();
+    if (parked() != 0)
+    {
+        fprintf(stderr, "mm_purge left blocks parked\n");
+        return 1;
+    }
+
+    // Without quick lists every block is coalesced as it is freed
+    if (!fill(0))
+    {
+        fprintf(stderr, "mm_malloc failed\n");
+        return 1;
+    }
+    mm_free(blocks[0]);
+    mm_set_quick(0);
+    if (parked() != 0)
+    {
+        fprintf(stderr, "mm_set_quick left blocks parked\n");
+        return 1;
+    }
+    for (size_t i = 1; i < NBLOCKS; i++)
+    {
+        mm_free(blocks[i]);
+    }
+    if (parked() != 0)
+    {
+        fprintf(stderr, "blocks were parked with no quick lists\n");
+        return 1;
+    }
+
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+    printf("quick ok\n");
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * remote_free.c: Checks that frees from a thread other than the owner of a
+ *                block reach the owning arena through its remote free queue.
+ *                The main thread allocates blocks from one arena, and a
+ *                thread of another arena frees them with free,
+ *                mm_free_batch and realloc. The blocks must stay live while
+ *                queued, be freed once REMOTE_THRESHOLD of them are queued,
+ *                and the rest when the owner next takes its lock; realloc
+ *                must move them rather than resize them in place.
+ *
+ * Build:  make tests/remote_free
+ * Usage:  tests/remote_free
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define REMOTE_THRESHOLD 64         // as in mm.c
+#define BLOCK_SIZE 2000             // above the thread cache and quick lists
+#define NBLOCKS (REMOTE_THRESHOLD + 16)
+#define NBATCH 10
+
+static void *blocks[NBLOCKS];
+static const char *failure;
+
+/*
+ * live: Returns the live bytes of mm_stats
+ */
+static size_t live(void)
+{
+    struct mm_stats st;
+
+    mm_stats(&st);
+    return st.live_bytes;
+}
+
+/*
+ * moved: Returns 1 if realloc of block i to size bytes, from this thread,
+ *        moves it and keeps its first bytes
+ */
+static int moved(size_t i, size_t size)
+{
+    char *p;
+
+    memset(blocks[i], (int)i, 64);
+    p = mm_realloc(blocks[i], size);
+    if (p == NULL || p == blocks[i])
+    {
+        return 0;
+    }
+    for (size_t j = 0; j < 64; j++)
+    {
+        if (p[j] != (char)i)
+        {
+            return 0;
+        }
+    }
+    mm_free(p);
+    return 1;
+}
+
+/*
+ * worker: Frees the blocks of the main thread from another arena
+ */
+static void *worker(void *arg)
+{
+    size_t before, queued;
+    size_t i;
+
+    (void)arg;
+    before = live();
+    for (i = 0; i < REMOTE_THRESHOLD - 1; i++)
+    {
+        mm_free(blocks[i]);
+    }
+    if (live() != before)
+    {
+        failure = "blocks were freed before the queue was full";
+        return NULL;
+    }
+    mm_free(blocks[i++]);
+    if (live() > before - REMOTE_THRESHOLD * BLOCK_SIZE)
+    {
+        failure = "the full queue was not drained";
+        return NULL;
+    }
+
+    // Shrinking and growing both move the block to this arena
+    if (!moved(i, BLOCK_SIZE / 2) || !moved(i + 1, BLOCK_SIZE * 2))
+    {
+        failure = "realloc resized a block of another arena in place";
+        return NULL;
+    }
+    i += 2;
+
+    queued = live();
+    mm_free_batch(blocks + i, NBATCH);
+    if (live() != queued)
+    {
+        failure = "mm_free_batch freed blocks of another arena";
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    size_t queued;
+    pthread_t t;
+    void *p;
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+    // Threads are assigned to the arenas in turn
+    mm_set_arenas(2, false);
+
+    for (size_t i = 0; i < NBLOCKS; i++)
+    {
+        if ((blocks[i] = mm_malloc(BLOCK_SIZE)) == NULL)
+        {
+            fprintf(stderr, "mm_malloc failed\n");
+            return 1;
+        }
+    }
+
+    if (pthread_create(&t, NULL, worker, NULL) != 0)
+    {
+        perror("pthread_create");
+        return 1;
+    }
+    pthread_join(t, NULL);
+    if (failure != NULL)
+    {
+        fprintf(stderr, "%s\n", failure);
+        return 1;
+    }
+
+    // The owner drains its queue when it next takes its lock
+    queued = live();
+    if ((p = mm_malloc(BLOCK_SIZE)) == NULL)
+    {
+        fprintf(stderr, "mm_malloc failed\n");
+        return 1;
+    }
+    if (live() > queued - (NBATCH + 2) * BLOCK_SIZE + 2 * BLOCK_SIZE)
+    {
+        fprintf(stderr, "the owner did not drain its queue\n");
+        return 1;
+    }
+    mm_free(p);
+    for (size_t i = REMOTE_THRESHOLD + 2 + NBATCH; i < NBLOCKS; i++)
+    {
+        mm_free(blocks[i]);
+    }
+
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+    printf("remote_free ok\n");
+    return 0;
+}
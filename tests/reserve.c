@@ -0,0 +1,146 @@
+/*
+ * reserve.c: Checks that the heap survives memlib moving the break to a new
+ *            reservation. The address space is limited so that the first
+ *            reservation is small, then 1 MiB blocks are allocated from two
+ *            arenas in turn, growing their regions in place and starting
+ *            new ones, until the heap runs out. The heap must have spread
+ *            over several reservations by then, except in the compact
+ *            layout, and every block must still hold its pattern and the
+ *            heap pass mm_check.
+ *
+ * Build:  make tests/reserve
+ * Usage:  tests/reserve
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define BLOCK_SIZE ((size_t)1 << 20)
+#define MAX_BLOCKS 4096
+#define BATCH 4                       // blocks allocated by each thread
+#define HEADROOM ((size_t)224 << 20)  // address space left for the heap
+
+static char *blocks[MAX_BLOCKS];
+static size_t nblocks;
+static int out_of_memory;
+
+/*
+ * fill: Writes the pattern of block i at both ends of it
+ */
+static void fill(size_t i)
+{
+    memset(blocks[i], (int)(i & 0xff), 64);
+    memset(blocks[i] + BLOCK_SIZE - 64, (int)(~i & 0xff), 64);
+}
+
+/*
+ * filled: Returns 1 if block i still holds its pattern
+ */
+static int filled(size_t i)
+{
+    for (size_t j = 0; j < 64; j++)
+    {
+        if (blocks[i][j] != (char)(i & 0xff) ||
+            blocks[i][BLOCK_SIZE - 64 + j] != (char)(~i & 0xff))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * worker: Allocates BATCH blocks from the arena of a new thread
+ */
+static void *worker(void *arg)
+{
+    (void)arg;
+    for (int k = 0; k < BATCH && nblocks < MAX_BLOCKS; k++)
+    {
+        if ((blocks[nblocks] = mm_malloc(BLOCK_SIZE)) == NULL)
+        {
+            out_of_memory = 1;
+            break;
+        }
+        fill(nblocks++);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    struct rlimit rl;
+    unsigned long pages;
+    uintptr_t lo = UINTPTR_MAX, hi = 0;
+    pthread_t t;
+    FILE *f;
+
+    // The first reservation gets what is left of the address space
+    if ((f = fopen("/proc/self/statm", "r")) == NULL ||
+        fscanf(f, "%lu", &pages) != 1)
+    {
+        perror("/proc/self/statm");
+        return 1;
+    }
+    fclose(f);
+    rl.rlim_cur = rl.rlim_max = pages * mem_pagesize() + HEADROOM;
+    if (setrlimit(RLIMIT_AS, &rl) != 0)
+    {
+        perror("setrlimit");
+        return 1;
+    }
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+    mm_set_arenas(2, false);
+
+    // Threads are assigned to the arenas in turn
+    while (!out_of_memory && nblocks < MAX_BLOCKS)
+    {
+        if (pthread_create(&t, NULL, worker, NULL) != 0)
+        {
+            perror("pthread_create");
+            return 1;
+        }
+        pthread_join(t, NULL);
+    }
+
+    for (size_t i = 0; i < nblocks; i++)
+    {
+        if (!filled(i))
+        {
+            fprintf(stderr, "block %zu at %p was overwritten\n", i,
+                    (void *)blocks[i]);
+            return 1;
+        }
+        lo = (uintptr_t)blocks[i] < lo ? (uintptr_t)blocks[i] : lo;
+        hi = (uintptr_t)blocks[i] > hi ? (uintptr_t)blocks[i] : hi;
+    }
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+#ifndef COMPACT
+    // The links of the compact layout only reach the 32 GiB past the first
+    // reservation, so its heap may run out there instead
+    if (hi - lo < mem_heapsize())
+    {
+        fprintf(stderr, "the heap never left its first reservation\n");
+        return 1;
+    }
+#endif
+
+    printf("reserve ok: %zu blocks\n", nblocks);
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * slab.c: Checks that slab objects are freed and reused, and that the spans
+ *         left empty go back to the heap. Objects of a few slab classes are
+ *         allocated, with the thread cache of their classes turned off, and
+ *         must be distinct, aligned and keep their contents. Freeing them
+ *         all must release every span but one per arena, and allocating them
+ *         again must reuse that memory rather than grow the heap.
+ *
+ * Build:  make tests/slab
+ * Usage:  tests/slab [objects = 20000]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define SLAB_SPAN_BYTES (8 * 4096)  // SLAB_SPAN slabs of SLAB_SIZE, as in mm.c
+
+static const size_t sizes[] = { 16, 48, 128, 256 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/*
+ * fill: Allocates n objects, of the sizes in turn, and writes their index
+ *       into each. Returns 0 if an allocation fails or is misaligned.
+ */
+static int fill(char **objs, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t size = sizes[i % NSIZES];
+
+        if ((objs[i] = mm_malloc(size)) == NULL ||
+            (uintptr_t)objs[i] % 16 != 0)
+        {
+            return 0;
+        }
+        memset(objs[i], (int)(i & 0xff), size);
+    }
+    return 1;
+}
+
+/*
+ * intact: Returns 1 if each of the n objects still holds its index
+ */
+static int intact(char **objs, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < sizes[i % NSIZES]; j++)
+        {
+            if (objs[i][j] != (char)(i & 0xff))
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? (size_t)atol(argv[1]) : 20000;
+    struct mm_stats base, full, empty, again;
+    char **objs = calloc(n, sizeof(*objs));
+
+    mem_init();
+    if (objs == NULL || !mm_init())
+    {
+        fprintf(stderr, "initialization failed\n");
+        return 1;
+    }
+    // Freed objects go straight back to their slabs
+    for (size_t s = 0; s < NSIZES; s++)
+    {
+        mm_tcache_set_capacity(sizes[s], 0);
+    }
+
+    mm_stats(&base);
+    if (!fill(objs, n) || !intact(objs, n))
+    {
+        fprintf(stderr, "objects overlap or are misaligned\n");
+        return 1;
+    }
+    mm_stats(&full);
+    if (full.slab_objects != base.slab_objects + n)
+    {
+        fprintf(stderr, "%zu slab objects for %zu allocated\n",
+                full.slab_objects - base.slab_objects, n);
+        return 1;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        mm_free(objs[i]);
+    }
+    mm_stats(&empty);
+    if (empty.slab_objects != base.slab_objects ||
+        empty.slab_bytes > base.slab_bytes + SLAB_SPAN_BYTES)
+    {
+        fprintf(stderr, "%zu objects and %zu bytes of slabs left\n",
+                empty.slab_objects - base.slab_objects,
+                empty.slab_bytes - base.slab_bytes);
+        return 1;
+    }
+
+    // The released spans serve the same objects again, apart from the
+    // slack of carving page-aligned spans out of the joined free blocks
+    if (!fill(objs, n) || !intact(objs, n))
+    {
+        fprintf(stderr, "reused objects overlap or are misaligned\n");
+        return 1;
+    }
+    mm_stats(&again);
+    if (again.heap_bytes > full.heap_bytes + full.slab_bytes / 8)
+    {
+        fprintf(stderr, "the heap grew from %zu to %zu bytes on reuse\n",
+                full.heap_bytes, again.heap_bytes);
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        mm_free(objs[i]);
+    }
+
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+    free(objs);
+    printf("slab ok\n");
+    return 0;
+}
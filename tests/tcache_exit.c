@@ -0,0 +1,100 @@
+/*
+ * tcache_exit.c: Checks that the thread cache of an exiting thread is given
+ *                back to the heap. Threads allocate and free blocks and slab
+ *                objects of sizes the cache holds, so that they stay cached
+ *                and count as live, and once each thread has exited the live
+ *                bytes must be back where they were before it started.
+ *
+ * Build:  make tests/tcache_exit
+ * Usage:  tests/tcache_exit [threads = 16]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define NOBJS 64
+
+static const size_t sizes[] = { 24, 64, 200, 512, 1000 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static size_t cached_live;
+
+/*
+ * worker: Allocates and frees NOBJS objects of each size, then records the
+ *         live bytes while its cache still holds some of them
+ */
+static void *worker(void *arg)
+{
+    void *objs[NOBJS];
+    struct mm_stats st;
+
+    (void)arg;
+    for (size_t s = 0; s < NSIZES; s++)
+    {
+        for (size_t i = 0; i < NOBJS; i++)
+        {
+            if ((objs[i] = mm_malloc(sizes[s])) == NULL)
+            {
+                return NULL;
+            }
+        }
+        for (size_t i = 0; i < NOBJS; i++)
+        {
+            mm_free(objs[i]);
+        }
+    }
+
+    mm_stats(&st);
+    cached_live = st.live_bytes;
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 16;
+    struct mm_stats before, after;
+    pthread_t t;
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        mm_stats(&before);
+        if (pthread_create(&t, NULL, worker, NULL) != 0)
+        {
+            perror("pthread_create");
+            return 1;
+        }
+        pthread_join(t, NULL);
+        mm_stats(&after);
+
+        if (cached_live <= before.live_bytes)
+        {
+            fprintf(stderr, "thread %d cached nothing\n", i);
+            return 1;
+        }
+        if (after.live_bytes != before.live_bytes)
+        {
+            fprintf(stderr, "thread %d left %zu live bytes behind\n", i,
+                    after.live_bytes - before.live_bytes);
+            return 1;
+        }
+    }
+
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+    printf("tcache_exit ok\n");
+    return 0;
+}
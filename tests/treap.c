@@ -0,0 +1,103 @@
+/*
+ * treap.c: Checks that free blocks of TREE_MIN bytes or more, kept in the
+ *          treap, are handed out by best fit. Large blocks of scattered
+ *          sizes are allocated between small ones, once no other large
+ *          free block is left, and freed. Requests a little smaller than
+ *          each of them, made in another order, must each be served from
+ *          the start of the smallest free block that holds them.
+ *
+ * Build:  make tests/treap
+ * Usage:  tests/treap
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define KIB ((size_t)1 << 10)
+#define TREE_MIN (256 * KIB)        // as in mm.c
+#define GUARD_SIZE 4096             // above the slabs and quick lists
+#define SLACK (16 * KIB)            // requested below each block size
+
+static const size_t sizes[] = { 300, 1400, 520, 760, 340, 410, 1100, 630,
+                                880, 380, 470, 1800 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+// The order of the requests, each block of sizes once
+static const size_t order[NSIZES] = { 6, 0, 11, 3, 9, 1, 4, 8, 2, 10, 7, 5 };
+
+static void *big[NSIZES];
+
+/*
+ * largest_free: Returns the size of the largest free block
+ */
+static size_t largest_free(void)
+{
+    struct mm_stats st;
+
+    mm_stats(&st);
+    return st.largest_free;
+}
+
+int main(void)
+{
+    void *p;
+
+    mem_init();
+    if (!mm_init())
+    {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    // Only the blocks freed below may serve the large requests
+    while (largest_free() >= TREE_MIN)
+    {
+        if (mm_malloc(largest_free() - 64) == NULL)
+        {
+            fprintf(stderr, "mm_malloc failed\n");
+            return 1;
+        }
+    }
+    if (mm_malloc(GUARD_SIZE) == NULL)
+    {
+        fprintf(stderr, "mm_malloc failed\n");
+        return 1;
+    }
+    for (size_t i = 0; i < NSIZES; i++)
+    {
+        if ((big[i] = mm_malloc(sizes[i] * KIB)) == NULL ||
+            mm_malloc(GUARD_SIZE) == NULL)
+        {
+            fprintf(stderr, "mm_malloc failed\n");
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < NSIZES; i++)
+    {
+        mm_free(big[i]);
+    }
+
+    // The blocks are at least SLACK apart, so only one is the best fit
+    for (size_t k = 0; k < NSIZES; k++)
+    {
+        size_t i = order[k];
+
+        if ((p = mm_malloc(sizes[i] * KIB - SLACK)) != big[i])
+        {
+            fprintf(stderr, "%zu KiB came from %p rather than %p\n",
+                    sizes[i] - SLACK / KIB, p, big[i]);
+            return 1;
+        }
+    }
+
+    if (!mm_check(MM_CHECK_FULL))
+    {
+        fprintf(stderr, "the heap is broken\n");
+        return 1;
+    }
+    printf("treap ok\n");
+    return 0;
+}